@@ -0,0 +1,101 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "albumindex.h"
+
+#include <QtAlgorithms>
+
+#include "collectionlist.h"
+#include "playlistsearch.h"
+#include "tag.h"
+
+static bool trackNumberLessThan(const CollectionListItem *a, const CollectionListItem *b)
+{
+    return a->file().tag()->track() < b->file().tag()->track();
+}
+
+static void insertSorted(AlbumIndex::ItemList &items, CollectionListItem *item)
+{
+    // Tracks with the same number stay in the order that they were added.
+
+    items.insert(qUpperBound(items.begin(), items.end(), item, trackNumberLessThan), item);
+}
+
+template<class Key>
+static void removeFrom(QHash<Key, AlbumIndex::ItemList> &index, const Key &key,
+                       CollectionListItem *item)
+{
+    typename QHash<Key, AlbumIndex::ItemList>::Iterator it = index.find(key);
+    if(it == index.end())
+        return;
+
+    it.value().removeOne(item);
+    if(it.value().isEmpty())
+        index.erase(it);
+}
+
+void AlbumIndex::insert(CollectionListItem *item)
+{
+    remove(item);
+
+    const Tag *tag = item->file().tag();
+
+    if(!tag || tag->album().isEmpty())
+        return;
+
+    const ArtistAlbum key(PlaylistSearch::foldText(tag->artist()),
+                          PlaylistSearch::foldText(tag->album()));
+
+    insertSorted(m_albums[key.second], item);
+    insertSorted(m_artistAlbums[key], item);
+    m_keys.insert(item, key);
+}
+
+void AlbumIndex::remove(CollectionListItem *item)
+{
+    QHash<CollectionListItem *, ArtistAlbum>::Iterator it = m_keys.find(item);
+    if(it == m_keys.end())
+        return;
+
+    removeFrom(m_albums, it.value().second, item);
+    removeFrom(m_artistAlbums, it.value(), item);
+
+    m_keys.erase(it);
+}
+
+void AlbumIndex::clear()
+{
+    m_albums.clear();
+    m_artistAlbums.clear();
+    m_keys.clear();
+}
+
+AlbumIndex::ItemList AlbumIndex::tracks(const QString &artist, const QString &album) const
+{
+    if(album.isEmpty())
+        return ItemList();
+
+    return m_artistAlbums.value(ArtistAlbum(PlaylistSearch::foldText(artist),
+                                            PlaylistSearch::foldText(album)));
+}
+
+AlbumIndex::ItemList AlbumIndex::tracks(const QString &album) const
+{
+    if(album.isEmpty())
+        return ItemList();
+
+    return m_albums.value(PlaylistSearch::foldText(album));
+}
+
+// vim: set et sw=4 tw=0 sta:
@@ -0,0 +1,73 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_ALBUMINDEX_H
+#define JUK_ALBUMINDEX_H
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+
+class CollectionListItem;
+
+/**
+ * Maps each album name to the CollectionListItems on it in track number order,
+ * so that the tracks of an album don't have to be searched for.  Names are
+ * compared case insensitively, like an Exact PlaylistSearch::Component that
+ * isn't case sensitive would.
+ *
+ * The tracks are indexed by their album as well as by their artist and album,
+ * as common album names (e.g. "Greatest Hits") are shared by many artists.
+ *
+ * Tracks without an album name aren't indexed.
+ */
+class AlbumIndex
+{
+public:
+    typedef QList<CollectionListItem *> ItemList;
+
+    /**
+     * Adds \p item to the index, replacing what was indexed for it before.
+     */
+    void insert(CollectionListItem *item);
+    void remove(CollectionListItem *item);
+    void clear();
+
+    /**
+     * Returns the tracks of \p album by \p artist, ordered by their track
+     * numbers.
+     */
+    ItemList tracks(const QString &artist, const QString &album) const;
+
+    /**
+     * Returns the tracks of every album called \p album, whatever their
+     * artist, ordered by their track numbers.
+     */
+    ItemList tracks(const QString &album) const;
+
+private:
+    typedef QPair<QString, QString> ArtistAlbum;
+
+    QHash<QString, ItemList> m_albums;
+    QHash<ArtistAlbum, ItemList> m_artistAlbums;
+
+    // The folded artist and album that each item was indexed under.
+
+    QHash<CollectionListItem *, ArtistAlbum> m_keys;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
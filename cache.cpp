@@ -16,7 +16,6 @@
  */
 
 #include "cache.h"
-#include "juk-exception.h"
 
 #include <kstandarddirs.h>
 #include <ksavefile.h>
@@ -24,33 +23,131 @@
 #include <kconfig.h>
 #include <klocale.h>
 #include <kdebug.h>
-#include <ktoggleaction.h>
 
+#include <QApplication>
 #include <QDir>
 #include <QBuffer>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QtEndian>
+#include <QVector>
+#include <QTimerEvent>
 
-#include "tag.h"
-#include "searchplaylist.h"
-#include "historyplaylist.h"
-#include "upcomingplaylist.h"
-#include "folderplaylist.h"
-#include "playlistcollection.h"
-#include "actioncollection.h"
+#include <algorithm>
 
-using namespace ActionCollection;
+#include "tag.h"
+#include "filehandle.h"
+#include "crc32c.h"
 
 const int Cache::playlistListCacheVersion = 3;
-const int Cache::playlistItemsCacheVersion = 2;
+const int Cache::playlistItemsCacheVersion = 3;
+
+// Written to mapped caches to detect files moved between machines of
+// different endianness, which we can't map directly.
+
+static const quint32 cacheByteOrderMark = 0x4a754b33;
+
+// Granularity of the checksums in mapped caches.  A damaged block loses at
+// most this many tracks, or this much string data.
 
-enum PlaylistType
+static const quint32 cacheRecordsPerBlock = 256;
+static const quint32 cacheStringBlockLength = 32768;
+
+static const qint32 cacheJournalVersion = 1;
+
+// Entries are only flushed this long after the first unflushed one, so that
+// adding a folder doesn't flush for every track.
+
+static const int cacheJournalFlushInterval = 2000; // ms
+
+enum JournalOperation
 {
-    Normal   = 0,
-    Search   = 1,
-    History  = 2,
-    Upcoming = 3,
-    Folder   = 4
+    JournalUpdate = 1,
+    JournalRemove = 2,
+    JournalRename = 3
 };
 
+static QString cacheJournalFileName()
+{
+    return KGlobal::dirs()->saveLocation("appdata") + "cache-journal";
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// helper functions
+////////////////////////////////////////////////////////////////////////////////
+
+/**
+ * FNV-1a over the UTF-16 data of \p path.  qHash() isn't guaranteed to stay
+ * the same between Qt versions, and this ends up on disk.
+ */
+static quint32 cachePathHash(const QString &path)
+{
+    quint32 hash = 2166136261u;
+    const ushort *data = path.utf16();
+
+    for(int i = 0; i < path.length(); ++i) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static bool cacheIndexLessThan(const CacheIndexEntry &a, const CacheIndexEntry &b)
+{
+    return a.hash < b.hash || (a.hash == b.hash && a.record < b.record);
+}
+
+static bool cacheIndexHashLessThan(const CacheIndexEntry &entry, quint32 hash)
+{
+    return entry.hash < hash;
+}
+
+/**
+ * Lets the user know that their music will be rescanned, when there is one.
+ * The indexer runs without a GUI.
+ */
+static void reportCorruptCache()
+{
+    if(!qobject_cast<QApplication *>(QCoreApplication::instance()))
+        return;
+
+    KMessageBox::sorry(0, i18n("The music data cache has been corrupted. JuK "
+                               "needs to rescan it now. This may take some time."));
+}
+
+static quint32 blockCount(quint64 length, quint32 blockLength)
+{
+    return quint32((length + blockLength - 1) / blockLength);
+}
+
+static CacheStringRef appendCacheString(QString &pool, const QString &value)
+{
+    CacheStringRef ref;
+    ref.offset = pool.length();
+    ref.length = value.length();
+    pool.append(value);
+
+    return ref;
+}
+
+/**
+ * Like appendCacheString(), but stores each distinct value only once, with
+ * every record holding it referring to the same entry.
+ */
+static CacheStringRef internCacheString(QString &pool, QHash<QString, CacheStringRef> &table,
+                                       const QString &value)
+{
+    QHash<QString, CacheStringRef>::ConstIterator it = table.constFind(value);
+    if(it != table.constEnd())
+        return *it;
+
+    CacheStringRef ref = appendCacheString(pool, value);
+    table.insert(value, ref);
+
+    return ref;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // public methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -61,241 +158,594 @@ Cache *Cache::instance()
     return &cache;
 }
 
-void Cache::loadPlaylists(PlaylistCollection *collection) // static
+bool Cache::cacheFileExists() // static
 {
-    QString playlistsFile = KGlobal::dirs()->saveLocation("appdata") + "playlists";
+    return QFile::exists(KGlobal::dirs()->saveLocation("appdata") + "cache");
+}
 
-    QFile f(playlistsFile);
+bool Cache::lock()
+{
+    if(!m_lockFile)
+        m_lockFile = new KLockFile(KGlobal::dirs()->saveLocation("appdata") + "cache.lock");
 
-    if(!f.open(QIODevice::ReadOnly))
+    // A lock left behind by a process which isn't running anymore is taken
+    // over rather than keeping the cache locked forever.
+
+    if(m_lockFile->isLocked() ||
+       m_lockFile->lock(KLockFile::NoBlockFlag | KLockFile::ForceFlag) == KLockFile::LockOK)
+    {
+        return true;
+    }
+
+    closeJournal();
+    return false;
+}
+
+bool Cache::isLocked() const
+{
+    return m_lockFile && m_lockFile->isLocked();
+}
+
+bool Cache::saveCachedItems(const FileHandleList &files) // static
+{
+    QString cacheFileName = KGlobal::dirs()->saveLocation("appdata") + "cache";
+
+    KSaveFile f(cacheFileName);
+
+    if(!f.open(QIODevice::WriteOnly)) {
+        kError() << "Error saving cache:" << f.errorString();
+        return false;
+    }
+
+    QVector<CacheRecord> records;
+    QVector<CacheIndexEntry> index;
+    QString strings;
+    QHash<QString, CacheStringRef> stringTable;
+
+    records.reserve(files.count());
+    index.reserve(files.count());
+
+    foreach(const FileHandle &file, files) {
+        const Tag *tag = file.tag();
+        const QString path = file.absFilePath();
+
+        CacheRecord record;
+        record.path     = appendCacheString(strings, path);
+        record.title    = internCacheString(strings, stringTable, tag->title());
+        record.artist   = internCacheString(strings, stringTable, tag->artist());
+        record.album    = internCacheString(strings, stringTable, tag->album());
+        record.genre    = internCacheString(strings, stringTable, tag->genre());
+        record.comment  = internCacheString(strings, stringTable, tag->comment());
+        record.track    = tag->track();
+        record.year     = tag->year();
+        record.bitrate  = tag->bitrate();
+        record.seconds  = tag->seconds();
+        record.modificationTime = file.lastModified().toMSecsSinceEpoch();
+        record.fileSize = file.fileInfo().size();
+
+        CacheIndexEntry entry;
+        entry.hash = cachePathHash(path);
+        entry.record = records.count();
+
+        records.append(record);
+        index.append(entry);
+    }
+
+    std::sort(index.begin(), index.end(), cacheIndexLessThan);
+
+    QVector<quint32> checksums;
+
+    for(int i = 0; i < records.count(); i += cacheRecordsPerBlock) {
+        const int count = qMin<int>(cacheRecordsPerBlock, records.count() - i);
+        checksums.append(crc32c(records.constData() + i, count * sizeof(CacheRecord)));
+    }
+
+    for(int i = 0; i < strings.length(); i += cacheStringBlockLength) {
+        const int length = qMin<int>(cacheStringBlockLength, strings.length() - i);
+        checksums.append(crc32c(strings.constData() + i, length * sizeof(QChar)));
+    }
+
+    CacheHeader header;
+    header.version = qToBigEndian<qint32>(playlistItemsCacheVersion);
+    header.byteOrderMark = cacheByteOrderMark;
+    header.recordCount = records.count();
+    header.recordSize = sizeof(CacheRecord);
+    header.recordOffset = sizeof(CacheHeader);
+    header.indexOffset = header.recordOffset + quint64(records.count()) * sizeof(CacheRecord);
+    header.checksumOffset = header.indexOffset + quint64(index.count()) * sizeof(CacheIndexEntry);
+    header.stringOffset = header.checksumOffset + quint64(checksums.count()) * sizeof(quint32);
+    header.stringLength = strings.length();
+    header.recordsPerBlock = cacheRecordsPerBlock;
+    header.stringBlockLength = cacheStringBlockLength;
+    header.indexChecksum = crc32c(index.constData(), index.count() * sizeof(CacheIndexEntry));
+    header.headerChecksum = 0;
+    header.headerChecksum = crc32c(&header, sizeof(CacheHeader));
+
+    f.write(reinterpret_cast<const char *>(&header), sizeof(CacheHeader));
+    f.write(reinterpret_cast<const char *>(records.constData()),
+            records.count() * sizeof(CacheRecord));
+    f.write(reinterpret_cast<const char *>(index.constData()),
+            index.count() * sizeof(CacheIndexEntry));
+    f.write(reinterpret_cast<const char *>(checksums.constData()),
+            checksums.count() * sizeof(quint32));
+    f.write(reinterpret_cast<const char *>(strings.constData()),
+            strings.length() * sizeof(QChar));
+
+    f.close();
+
+    if(!f.finalize()) {
+        kError() << "Error saving cache:" << f.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+void Cache::journalUpdate(const FileHandle &file)
+{
+    QByteArray entry;
+    QDataStream s(&entry, QIODevice::WriteOnly);
+    s.setVersion(QDataStream::Qt_4_3);
+
+    s << qint32(JournalUpdate) << file.absFilePath() << file;
+    appendToJournal(entry);
+}
+
+void Cache::journalRemove(const QString &path)
+{
+    QByteArray entry;
+    QDataStream s(&entry, QIODevice::WriteOnly);
+    s.setVersion(QDataStream::Qt_4_3);
+
+    s << qint32(JournalRemove) << path;
+    appendToJournal(entry);
+}
+
+void Cache::journalRename(const QString &oldPath, const QString &newPath)
+{
+    if(oldPath == newPath)
         return;
 
-    QDataStream fs(&f);
-    int dataStreamVersion = QDataStream::Qt_3_3;
+    QByteArray entry;
+    QDataStream s(&entry, QIODevice::WriteOnly);
+    s.setVersion(QDataStream::Qt_4_3);
 
-    qint32 version;
-    fs >> version;
-    kDebug() << "Playlists file is version" << version;
+    s << qint32(JournalRename) << oldPath << newPath;
+    appendToJournal(entry);
+}
 
-    switch(version) {
-    case 3:
-        dataStreamVersion = QDataStream::Qt_4_3;
-        // Fall-through
+bool Cache::journalNeedsCompaction() const
+{
+    // Renames can only be replayed against a mapped cache, so anything older
+    // is always rewritten.
 
-    case 1:
-    case 2:
+    if(!m_mapFile.isOpen())
+        return true;
+
+    // Rewriting drops the damaged blocks, which otherwise would be checked
+    // and skipped again on every start.
+
+    if(m_damagedRecordBlocks.count(true) > 0 || m_damagedStringBlocks.count(true) > 0)
+        return true;
+
+    return QFileInfo(cacheJournalFileName()).size() > m_mapFile.size() / 4;
+}
+
+void Cache::discardJournal()
+{
+    m_journalFlushTimer.stop();
+    m_journalFile.close();
+    QFile::remove(cacheJournalFileName());
+}
+
+void Cache::closeJournal()
+{
+    // Closing the file writes whatever is left in its buffer.
+
+    m_journalFlushTimer.stop();
+    m_journalFile.close();
+    m_journalClosed = true;
+}
+
+Tag *Cache::cachedTag(const FileHandle &file) const
+{
+    if(!m_index)
+        return 0;
+
+    const CacheRecord *record = findCachedRecord(file.absFilePath());
+
+    if(!record || record->modificationTime < file.lastModified().toMSecsSinceEpoch() ||
+       record->fileSize != file.fileInfo().size())
     {
-        // Our checksum is only for the values after the version and checksum so
-        // we want to get a byte array with just the checksummed data.
+        return 0;
+    }
 
-        QByteArray data;
-        quint16 checksum;
-        fs >> checksum >> data;
+    return new Tag(file.absFilePath(), record);
+}
 
-        if(checksum != qChecksum(data.data(), data.size()))
-            return;
+QString Cache::cachedString(const CacheStringRef &ref) const
+{
+    if(!m_strings || ref.offset > m_stringLength || ref.length > m_stringLength - ref.offset)
+        return QString();
 
-        // If we chose the wrong QDataStream version we may have to back out
-        // and try again, so get ready by noting the playlists we have made.
-
-        QList<Playlist *> createdPlaylists;
-        bool errorOccurred = true;
-
-        while(errorOccurred) {
-            // Create a new stream just based on the data.
-
-            QDataStream s(&data, QIODevice::ReadOnly);
-            s.setVersion(dataStreamVersion);
-
-            try { // Failure due to wrong version can be indicated by an exception
-
-            while(!s.atEnd()) {
-
-                qint32 playlistType;
-                s >> playlistType;
-
-                Playlist *playlist = 0;
-
-                switch(playlistType) {
-                case Search:
-                {
-                    SearchPlaylist *p = new SearchPlaylist(collection);
-                    createdPlaylists.append(p);
-                    s >> *p;
-                    playlist = p;
-                    break;
-                }
-                case History:
-                {
-                    action<KToggleAction>("showHistory")->setChecked(true);
-                    collection->setHistoryPlaylistEnabled(true);
-                    s >> *collection->historyPlaylist();
-                    playlist = collection->historyPlaylist();
-                    break;
-                }
-                case Upcoming:
-                {
-                    /*
-                    collection->setUpcomingPlaylistEnabled(true);
-                    Playlist *p = collection->upcomingPlaylist();
-                    action<KToggleAction>("saveUpcomingTracks")->setChecked(true);
-                    s >> *p;
-                    playlist = p;
-                    */
-                    break;
-                }
-                case Folder:
-                {
-                    FolderPlaylist *p = new FolderPlaylist(collection);
-                    createdPlaylists.append(p);
-                    s >> *p;
-                    playlist = p;
-                    break;
-                }
-                default:
-                    Playlist *p = new Playlist(collection, true);
-                    createdPlaylists.append(p);
-                    s >> *p;
-
-                    // We may have already read this playlist from the folder
-                    // scanner, if an .m3u playlist
-                    if(collection->containsPlaylistFile(p->fileName())) {
-                        delete p;
-                        p = 0;
-                    }
-
-                    playlist = p;
-                    break;
-                } // switch
-
-                if(version >= 2) {
-                    qint32 sortColumn;
-                    s >> sortColumn;
-                    if(playlist)
-                        playlist->setSorting(sortColumn);
-                }
-
-            } // while !s.atEnd()
-
-            // Must be ok if we got this far, break out of loop.
-            errorOccurred = false;
-
-            } // try
-            catch(BICStreamException &) {
-                kError() << "Exception loading playlists - binary incompatible stream.";
-
-                // Delete created playlists which probably have junk now.
-                foreach(Playlist *p, createdPlaylists)
-                    delete p;
-                createdPlaylists.clear();
-
-                if(dataStreamVersion == QDataStream::Qt_3_3) {
-                    kError() << "Attempting other binary protocol - Qt 4.3";
-                    dataStreamVersion = QDataStream::Qt_4_3;
-
-                    break; // escape from while(!s.atEnd()) to try again
-                }
-#if QT_VERSION >= 0x040400
-                // Unlikely, but maybe user had Qt 4.4 with KDE 4.0.0?
-                else if(dataStreamVersion == QDataStream::Qt_4_3) {
-                    kError() << "Attempting other binary protocol - Qt 4.4";
-                    dataStreamVersion = QDataStream::Qt_4_4;
-
-                    break;
-                }
-#endif
-                // We tried 3.3 first, if 4.3/4.4 doesn't work who knows...
-                kError() << "Unable to recover, no playlists will be loaded.";
-                return;
-            } // catch
-        } // while dataStreamVersion != -1
-        break;
+    return QString::fromRawData(m_strings + ref.offset, ref.length);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// protected methods
+////////////////////////////////////////////////////////////////////////////////
+
+void Cache::timerEvent(QTimerEvent *event)
+{
+    if(event->timerId() != m_journalFlushTimer.timerId()) {
+        QObject::timerEvent(event);
+        return;
+    }
+
+    m_journalFlushTimer.stop();
+    m_journalFile.flush();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private methods
+////////////////////////////////////////////////////////////////////////////////
+
+Cache::Cache() :
+    m_records(0),
+    m_index(0),
+    m_strings(0),
+    m_recordCount(0),
+    m_stringLength(0),
+    m_nextRecord(0),
+    m_recordsPerBlock(1),
+    m_stringBlockLength(1),
+    m_journalClosed(false)
+{
+    // The cache may first be used from a thread reading tags, but the journal
+    // is flushed from the main thread's event loop.
+
+    if(QCoreApplication::instance())
+        moveToThread(QCoreApplication::instance()->thread());
+}
+
+bool Cache::mapCachedItems()
+{
+    // Map the file separately from m_loadFile as the mapping has to outlive
+    // the loading process.
+
+    m_mapFile.setFileName(m_loadFile.fileName());
+    m_loadDataStream.setDevice(0);
+    m_loadFile.close();
+
+    if(!m_mapFile.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = m_mapFile.size();
+    const uchar *data = 0;
+
+    if(size >= qint64(sizeof(CacheHeader)))
+        data = m_mapFile.map(0, size);
+
+    if(!data) {
+        kError() << "Unable to map music cache:" << m_mapFile.errorString();
+        m_mapFile.close();
+        return false;
     }
-    default:
+
+    const CacheHeader *header = reinterpret_cast<const CacheHeader *>(data);
+
+    // The rest of the file can be partially recovered, but without a good
+    // header there's nothing to go on.
+
+    CacheHeader headerCopy = *header;
+    headerCopy.headerChecksum = 0;
+
+    // Reject anything that would point outside of the file before doing any
+    // arithmetic with it.
+
+    bool valid = header->headerChecksum == crc32c(&headerCopy, sizeof(CacheHeader)) &&
+                 header->recordOffset <= quint64(size) && header->indexOffset <= quint64(size) &&
+                 header->checksumOffset <= quint64(size) &&
+                 header->stringOffset <= quint64(size) && header->stringLength <= quint64(size) &&
+                 header->recordsPerBlock > 0 && header->stringBlockLength > 0 &&
+                 header->recordOffset % sizeof(qint64) == 0 &&
+                 header->indexOffset % sizeof(quint32) == 0 &&
+                 header->checksumOffset % sizeof(quint32) == 0 &&
+                 header->stringOffset % sizeof(QChar) == 0;
+
+    const quint64 checksumCount = valid
+        ? quint64(blockCount(header->recordCount, header->recordsPerBlock)) +
+          blockCount(header->stringLength, header->stringBlockLength)
+        : 0;
+
+    const quint64 recordsEnd = header->recordOffset + quint64(header->recordCount) * sizeof(CacheRecord);
+    const quint64 indexEnd = header->indexOffset + quint64(header->recordCount) * sizeof(CacheIndexEntry);
+    const quint64 checksumsEnd = header->checksumOffset + checksumCount * sizeof(quint32);
+    const quint64 stringsEnd = header->stringOffset + header->stringLength * sizeof(QChar);
+
+    if(!valid || header->byteOrderMark != cacheByteOrderMark ||
+       header->recordSize != sizeof(CacheRecord) ||
+       recordsEnd > quint64(size) || indexEnd > quint64(size) ||
+       checksumsEnd > quint64(size) || stringsEnd > quint64(size))
     {
-        // Because the original version of the playlist cache did not contain a
-        // version number, we want to revert to the beginning of the file before
-        // reading the data.
+        kError() << "Music cache header is invalid";
+        m_mapFile.unmap(const_cast<uchar *>(data));
+        m_mapFile.close();
+
+        reportCorruptCache();
+        return false;
+    }
+
+    m_records = reinterpret_cast<const CacheRecord *>(data + header->recordOffset);
+    m_index = reinterpret_cast<const CacheIndexEntry *>(data + header->indexOffset);
+    m_strings = reinterpret_cast<const QChar *>(data + header->stringOffset);
+    m_recordCount = header->recordCount;
+    m_stringLength = header->stringLength;
+    m_nextRecord = 0;
+    m_recordsPerBlock = header->recordsPerBlock;
+    m_stringBlockLength = header->stringBlockLength;
+
+    checkCachedBlocks(header, data);
+
+    return true;
+}
+
+void Cache::checkCachedBlocks(const CacheHeader *header, const uchar *data)
+{
+    const quint32 recordBlocks = blockCount(m_recordCount, m_recordsPerBlock);
+    const quint32 stringBlocks = blockCount(m_stringLength, m_stringBlockLength);
+    const quint32 *checksums = reinterpret_cast<const quint32 *>(data + header->checksumOffset);
+
+    m_damagedRecordBlocks.fill(false, recordBlocks);
+    m_damagedStringBlocks.fill(false, stringBlocks);
+
+    int damaged = 0;
 
-        f.reset();
+    for(quint32 i = 0; i < recordBlocks; ++i) {
+        const quint32 first = i * m_recordsPerBlock;
+        const quint32 count = qMin(m_recordsPerBlock, m_recordCount - first);
 
-         while(!fs.atEnd()) {
-            Playlist *p = new Playlist(collection);
-            fs >> *p;
+        if(crc32c(m_records + first, quint64(count) * sizeof(CacheRecord)) != checksums[i]) {
+            m_damagedRecordBlocks.setBit(i);
+            ++damaged;
         }
-        break;
     }
+
+    for(quint32 i = 0; i < stringBlocks; ++i) {
+        const quint32 first = i * m_stringBlockLength;
+        const quint32 length = qMin(m_stringBlockLength, m_stringLength - first);
+
+        if(crc32c(m_strings + first, quint64(length) * sizeof(QChar)) != checksums[recordBlocks + i]) {
+            m_damagedStringBlocks.setBit(i);
+            ++damaged;
+        }
     }
 
-    f.close();
+    // The index only speeds up lookups, we can do without it.
+
+    if(crc32c(m_index, quint64(m_recordCount) * sizeof(CacheIndexEntry)) != header->indexChecksum) {
+        kWarning() << "Music cache index is damaged, cached tags won't be looked up by path.";
+        m_index = 0;
+    }
+
+    if(damaged > 0)
+        kWarning() << damaged << "blocks of the music cache are damaged, affected tracks will be reread.";
 }
 
-void Cache::savePlaylists(const PlaylistList &playlists)
+bool Cache::isRecordIntact(const CacheRecord *record) const
 {
-    QString dirName = KGlobal::dirs()->saveLocation("appdata");
-    QString playlistsFile = dirName + "playlists";
-    KSaveFile f(playlistsFile);
+    const quint32 i = record - m_records;
 
-    if(!f.open(QIODevice::WriteOnly)) {
-        kError() << "Error saving collection:" << f.errorString();
-        return;
+    return !m_damagedRecordBlocks.testBit(i / m_recordsPerBlock) &&
+        isStringIntact(record->path) && isStringIntact(record->title) &&
+        isStringIntact(record->artist) && isStringIntact(record->album) &&
+        isStringIntact(record->genre) && isStringIntact(record->comment);
+}
+
+bool Cache::isStringIntact(const CacheStringRef &ref) const
+{
+    if(ref.offset > m_stringLength || ref.length > m_stringLength - ref.offset)
+        return false;
+
+    if(ref.length == 0)
+        return true;
+
+    const quint32 first = ref.offset / m_stringBlockLength;
+    const quint32 last = (ref.offset + ref.length - 1) / m_stringBlockLength;
+
+    for(quint32 block = first; block <= last; ++block) {
+        if(m_damagedStringBlocks.testBit(block))
+            return false;
     }
 
-    QByteArray data;
-    QDataStream s(&data, QIODevice::WriteOnly);
-    s.setVersion(QDataStream::Qt_4_3);
+    return true;
+}
 
-    for(PlaylistList::ConstIterator it = playlists.begin(); it != playlists.end(); ++it) {
-        if(*it) {
-            if(dynamic_cast<HistoryPlaylist *>(*it)) {
-                s << qint32(History)
-                  << *static_cast<HistoryPlaylist *>(*it);
-            }
-            else if(dynamic_cast<SearchPlaylist *>(*it)) {
-                s << qint32(Search)
-                  << *static_cast<SearchPlaylist *>(*it);
-            }
-            else if(dynamic_cast<UpcomingPlaylist *>(*it)) {
-                if(!action<KToggleAction>("saveUpcomingTracks")->isChecked())
-                    continue;
-                s << qint32(Upcoming)
-                  << *static_cast<UpcomingPlaylist *>(*it);
-            }
-            else if(dynamic_cast<FolderPlaylist *>(*it)) {
-                s << qint32(Folder)
-                  << *static_cast<FolderPlaylist *>(*it);
+const CacheRecord *Cache::findCachedRecord(const QString &path) const
+{
+    const quint32 hash = cachePathHash(path);
+    const CacheIndexEntry *end = m_index + m_recordCount;
+    const CacheIndexEntry *it = std::lower_bound(m_index, end, hash, cacheIndexHashLessThan);
+
+    for(; it != end && it->hash == hash; ++it) {
+        if(it->record < m_recordCount && isRecordIntact(&m_records[it->record]) &&
+           cachedString(m_records[it->record].path) == path)
+        {
+            return &m_records[it->record];
+        }
+    }
+
+    return 0;
+}
+
+FileHandle Cache::loadNextBaseItem()
+{
+    if(m_records) {
+        while(m_nextRecord < m_recordCount) {
+            const CacheRecord *record = &m_records[m_nextRecord++];
+
+            // Nothing in a damaged record can be trusted, not even the path,
+            // so those tracks are left for the folder scan to find again.
+
+            if(m_damagedRecordBlocks.testBit((m_nextRecord - 1) / m_recordsPerBlock))
+                continue;
+
+            if(!isStringIntact(record->path))
+                continue;
+
+            const QString fileName = cachedString(record->path);
+
+            if(!QFile::exists(fileName)) {
+                kWarning() << "File" << fileName << "no longer exists!";
+                continue;
             }
-            else {
-                s << qint32(Normal)
-                  << *(*it);
+
+            // If only the tag data is damaged the track is reread from disk,
+            // while we're still off of the GUI thread.
+
+            if(!isRecordIntact(record)) {
+                FileHandle file(fileName);
+                file.tag();
+                return file;
             }
-            s << qint32((*it)->sortColumn());
+
+            return FileHandle(fileName, new Tag(fileName, record),
+                              QDateTime::fromMSecsSinceEpoch(record->modificationTime));
         }
+
+        return FileHandle::null();
     }
 
-    QDataStream fs(&f);
-    fs << qint32(playlistListCacheVersion);
-    fs << qChecksum(data.data(), data.size());
+    // Already completed reading the cache file, or it was never opened.
 
-    fs << data;
-    f.close();
+    if(!m_loadFile.isOpen() || !m_loadDataStream.device())
+        return FileHandle::null();
 
-    if(!f.finalize())
-        kError() << "Error saving collection:" << f.errorString();
+    if(m_loadDataStream.status() == QDataStream::ReadCorruptData) {
+        kError() << "Attempted to read file handle from corrupt cache file.";
+        return FileHandle::null();
+    }
+
+    if(!m_loadDataStream.atEnd()) {
+        QString fileName;
+        m_loadDataStream >> fileName;
+        fileName.squeeze();
+
+        return FileHandle(fileName, m_loadDataStream);
+    }
+    else {
+        m_loadDataStream.setDevice(0);
+        m_loadFile.close();
+
+        return FileHandle::null();
+    }
 }
 
-bool Cache::cacheFileExists() // static
+void Cache::readJournal()
 {
-    return QFile::exists(KGlobal::dirs()->saveLocation("appdata") + "cache");
-}
+    m_journal.clear();
 
-////////////////////////////////////////////////////////////////////////////////
-// private methods
-////////////////////////////////////////////////////////////////////////////////
+    QFile f(cacheJournalFileName());
+
+    if(!f.open(QIODevice::ReadOnly))
+        return;
+
+    QDataStream fs(&f);
+    fs.setVersion(QDataStream::Qt_4_3);
+
+    qint32 version = 0;
+    fs >> version;
+
+    if(version != cacheJournalVersion) {
+        kWarning() << "Ignoring music cache journal of unknown version" << version;
+        return;
+    }
+
+    while(!fs.atEnd()) {
+        quint16 checksum;
+        QByteArray entry;
+        fs >> checksum >> entry;
+
+        // The last entry may be incomplete if JuK didn't exit cleanly.
+
+        if(fs.status() != QDataStream::Ok || checksum != qChecksum(entry.data(), entry.size())) {
+            kWarning() << "Music cache journal ends with a damaged entry, ignoring it.";
+            break;
+        }
+
+        QDataStream s(&entry, QIODevice::ReadOnly);
+        s.setVersion(QDataStream::Qt_4_3);
+
+        qint32 operation;
+        QString path;
+        s >> operation >> path;
+
+        switch(operation) {
+        case JournalUpdate:
+            m_journal.insert(path, entry.mid(s.device()->pos()));
+            break;
+        case JournalRemove:
+            m_journal.insert(path, QByteArray());
+            break;
+        case JournalRename:
+        {
+            QString newPath;
+            s >> newPath;
+
+            QByteArray data;
+
+            if(m_journal.contains(path))
+                data = m_journal.value(path);
+            else if(const CacheRecord *record = m_index ? findCachedRecord(path) : 0) {
+                QDataStream recordStream(&data, QIODevice::WriteOnly);
+                recordStream.setVersion(QDataStream::Qt_4_3);
+
+                recordStream << Tag(newPath, record)
+                             << QDateTime::fromMSecsSinceEpoch(record->modificationTime);
+            }
+
+            m_journal.insert(path, QByteArray());
+            if(!data.isEmpty())
+                m_journal.insert(newPath, data);
+            break;
+        }
+        default:
+            kWarning() << "Unknown music cache journal entry" << operation;
+            break;
+        }
+    }
 
-Cache::Cache()
+    kDebug() << "Replayed" << m_journal.count() << "entries from the music cache journal";
+}
+
+void Cache::appendToJournal(const QByteArray &entry)
 {
+    if(m_journalClosed)
+        return;
+
+    if(!m_journalFile.isOpen()) {
+        m_journalFile.setFileName(cacheJournalFileName());
+
+        if(!m_journalFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+            kError() << "Unable to open music cache journal:" << m_journalFile.errorString();
+            return;
+        }
+
+        if(m_journalFile.size() == 0) {
+            QDataStream fs(&m_journalFile);
+            fs.setVersion(QDataStream::Qt_4_3);
+            fs << cacheJournalVersion;
+        }
+    }
 
+    QDataStream fs(&m_journalFile);
+    fs.setVersion(QDataStream::Qt_4_3);
+    fs << qChecksum(entry.data(), entry.size()) << entry;
+
+    // A crash loses at most the entries since the last flush.
+
+    if(!m_journalFlushTimer.isActive())
+        m_journalFlushTimer.start(cacheJournalFlushInterval, this);
 }
 
 bool Cache::prepareToLoadCachedItems()
@@ -314,6 +764,11 @@ bool Cache::prepareToLoadCachedItems()
     m_loadDataStream >> version;
 
     switch(version) {
+    case 3:
+        if(!mapCachedItems())
+            return false;
+        break;
+
     case 2:
         dataStreamVersion = CacheDataStream::Qt_4_3;
 
@@ -338,8 +793,7 @@ bool Cache::prepareToLoadCachedItems()
         {
             kError() << "Music cache checksum expected to get" << checksumExpected <<
                         "actually was" << checksum;
-            KMessageBox::sorry(0, i18n("The music data cache has been corrupted. JuK "
-                                       "needs to rescan it now. This may take some time."));
+            reportCorruptCache();
             return false;
         }
 
@@ -356,34 +810,44 @@ bool Cache::prepareToLoadCachedItems()
     }
     }
 
+    readJournal();
+
     return true;
 }
 
 FileHandle Cache::loadNextCachedItem()
 {
-    if(!m_loadFile.isOpen() || !m_loadDataStream.device()) {
-        kWarning() << "Already completed reading cache file.";
-        return FileHandle::null();
-    }
+    // Tracks from the cache file come first.  Those which have an entry in
+    // the journal are skipped and instead restored from the journal after.
 
-    if(m_loadDataStream.status() == QDataStream::ReadCorruptData) {
-        kError() << "Attempted to read file handle from corrupt cache file.";
-        return FileHandle::null();
+    FileHandle file;
+
+    while(!(file = loadNextBaseItem()).isNull()) {
+        if(!m_journal.contains(file.absFilePath()))
+            return file;
     }
 
-    if(!m_loadDataStream.atEnd()) {
-        QString fileName;
-        m_loadDataStream >> fileName;
-        fileName.squeeze();
+    while(!m_journal.isEmpty()) {
+        QHash<QString, QByteArray>::Iterator it = m_journal.begin();
+        const QString fileName = it.key();
+        QByteArray data = it.value();
 
-        return FileHandle(fileName, m_loadDataStream);
-    }
-    else {
-        m_loadDataStream.setDevice(0);
-        m_loadFile.close();
+        m_journal.erase(it);
 
-        return FileHandle::null();
+        if(data.isEmpty() || !QFile::exists(fileName))
+            continue;
+
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+
+        CacheDataStream s(&buffer);
+        s.setVersion(CacheDataStream::Qt_4_3);
+        s.setCacheVersion(1);
+
+        return FileHandle(fileName, s);
     }
+
+    return FileHandle::null();
 }
 
 // vim: set et sw=4 tw=0 sta:
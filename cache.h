@@ -21,15 +21,97 @@
 #include <QtCore/QDataStream>
 #include <QtCore/QFile>
 #include <QtCore/QBuffer>
+#include <QtCore/QString>
+#include <QtCore/QHash>
+#include <QtCore/QByteArray>
+#include <QtCore/QBitArray>
+#include <QtCore/QBasicTimer>
+#include <QtCore/QObject>
+
+#include <klockfile.h>
 
 class Playlist;
 class PlaylistCollection;
 class FileHandle;
+class Tag;
 
 template<class T>
 class QList;
 
 typedef QList<Playlist *> PlaylistList;
+typedef QList<FileHandle> FileHandleList;
+
+/**
+ * The structures below describe the on-disk layout of the version 3 music
+ * cache.  Unlike the older versions this file is not streamed through a
+ * QDataStream but mapped into memory and read in place, so that tracks can
+ * be restored without copying or decoding the whole file up front.
+ *
+ * The file is laid out as a CacheHeader, followed by a table of fixed size
+ * CacheRecords, an index of CacheIndexEntries sorted by path hash, a table of
+ * block checksums and finally a pool of UTF-16 string data which the records
+ * point into.  All values are in host byte order except for the leading
+ * version number, which is big endian so that it can be told apart from the
+ * older formats.
+ *
+ * The record table and the string pool are split into blocks which are
+ * checksummed (CRC32C) separately, so that damage to the file only costs the
+ * tracks stored in the damaged blocks.  The checksum table holds one checksum
+ * per record block followed by one per string block.
+ *
+ * Apart from paths, each distinct string is stored in the pool only once and
+ * all records using it refer to the same CacheStringRef, so the pool doubles
+ * as a string table for artists, albums, genres and so on.
+ */
+
+struct CacheHeader
+{
+    qint32 version;
+    quint32 byteOrderMark;
+    quint32 recordCount;
+    quint32 recordSize;
+    quint64 recordOffset;
+    quint64 indexOffset;
+    quint64 stringOffset;
+    quint64 stringLength; ///< In QChars, not bytes.
+    quint64 checksumOffset;
+    quint32 recordsPerBlock;
+    quint32 stringBlockLength; ///< In QChars, not bytes.
+    quint32 indexChecksum;
+    quint32 headerChecksum; ///< Computed with this field set to 0.
+};
+
+/**
+ * A reference to a string in the string pool of the cache, in QChars.
+ */
+
+struct CacheStringRef
+{
+    quint32 offset;
+    quint32 length;
+};
+
+struct CacheRecord
+{
+    CacheStringRef path;
+    CacheStringRef title;
+    CacheStringRef artist;
+    CacheStringRef album;
+    CacheStringRef genre;
+    CacheStringRef comment;
+    qint32 track;
+    qint32 year;
+    qint32 bitrate;
+    qint32 seconds;
+    qint64 modificationTime; ///< Milliseconds since the epoch.
+    qint64 fileSize;
+};
+
+struct CacheIndexEntry
+{
+    quint32 hash;
+    quint32 record;
+};
 
 /**
  * A simple QDataStream subclass that has an extra field to indicate the cache
@@ -50,7 +132,7 @@ private:
 };
 
 
-class Cache
+class Cache : public QObject
 {
 public:
     static Cache *instance();
@@ -60,9 +142,65 @@ public:
 
     static bool cacheFileExists();
 
+    /**
+     * Takes the lock file next to the music cache.  JuK holds it while it runs
+     * and juk-indexer while it writes the cache, since each would otherwise
+     * overwrite the cache written by the other.  Returns false if the lock is
+     * held by another process, in which case the journal is closed as well.
+     * The lock is released when the process exits.
+     */
+    bool lock();
+    bool isLocked() const;
+
     bool prepareToLoadCachedItems();
     FileHandle loadNextCachedItem();
 
+    /**
+     * Writes the music cache for the given files, replacing the current one.
+     * Returns false if the cache could not be written.
+     */
+    static bool saveCachedItems(const FileHandleList &files);
+
+    /**
+     * These append a change to the journal kept next to the music cache.  The
+     * journal is replayed on top of the cache when it is loaded, so that
+     * small changes don't require the whole cache to be rewritten.
+     */
+    void journalUpdate(const FileHandle &file);
+    void journalRemove(const QString &path);
+    void journalRename(const QString &oldPath, const QString &newPath);
+
+    /**
+     * Returns true if the journal has grown large enough (or the cache is of
+     * an older version or has damaged blocks) that the cache should be
+     * rewritten with saveCachedItems().
+     */
+    bool journalNeedsCompaction() const;
+
+    /**
+     * Removes the journal, to be called once its changes are in the cache.
+     */
+    void discardJournal();
+
+    /**
+     * Stops recording changes in the journal, e.g. while shutting down.  Any
+     * entries which haven't been flushed yet are written first.
+     */
+    void closeJournal();
+
+    /**
+     * Returns a new Tag for \p file restored from the music cache, or 0 if
+     * the cache has no entry for the file or the file has been modified or
+     * changed size since it was cached.  This only works with a mapped (version 3) cache.
+     */
+    Tag *cachedTag(const FileHandle &file) const;
+
+    /**
+     * Returns the string referred to by \p ref.  The string points directly
+     * into the mapped cache file, no copy of the data is made.
+     */
+    QString cachedString(const CacheStringRef &ref) const;
+
     /**
      * QDataStream version for serialized list of playlists
      * 1, 2: Who knows?
@@ -74,17 +212,62 @@ public:
      * QDataStream version for serialized list of playlist items in a playlist
      * 1: Original cache version
      * 2: KDE 4.0.1+, explicitly sets QDataStream encoding.
+     * 3: Memory mapped record table, see CacheHeader.
      */
     static const int playlistItemsCacheVersion;
 
+protected:
+    /**
+     * Flushes the journal, see appendToJournal().
+     */
+    virtual void timerEvent(QTimerEvent *event);
+
 private:
     // private to force access through instance()
     Cache();
 
+    bool mapCachedItems();
+    void checkCachedBlocks(const CacheHeader *header, const uchar *data);
+    bool isRecordIntact(const CacheRecord *record) const;
+    bool isStringIntact(const CacheStringRef &ref) const;
+    const CacheRecord *findCachedRecord(const QString &path) const;
+    FileHandle loadNextBaseItem();
+
+    void readJournal();
+    void appendToJournal(const QByteArray &entry);
+
 private:
     QFile m_loadFile;
     QBuffer m_loadFileBuffer;
     CacheDataStream m_loadDataStream;
+
+    // Only used for version 3 caches.  The mapping stays valid for the life
+    // of the process since Tags refer to its string data.
+
+    QFile m_mapFile;
+    const CacheRecord *m_records;
+    const CacheIndexEntry *m_index;
+    const QChar *m_strings;
+    quint32 m_recordCount;
+    quint32 m_stringLength;
+    quint32 m_nextRecord;
+    quint32 m_recordsPerBlock;
+    quint32 m_stringBlockLength;
+
+    // Blocks of the cache which failed their checksum.
+
+    QBitArray m_damagedRecordBlocks;
+    QBitArray m_damagedStringBlocks;
+
+    // Serialized FileHandles from the journal, keyed by path.  An empty
+    // entry means the track was removed.
+
+    QHash<QString, QByteArray> m_journal;
+    QFile m_journalFile;
+    QBasicTimer m_journalFlushTimer;
+    bool m_journalClosed;
+
+    KLockFile::Ptr m_lockFile;
 };
 
 #endif
@@ -0,0 +1,196 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cachechecker.h"
+
+#include <kstandarddirs.h>
+#include <ksavefile.h>
+#include <kglobal.h>
+#include <kdebug.h>
+
+#include <QtCore/QMutexLocker>
+#include <QtCore/QFileInfo>
+#include <QtCore/QDateTime>
+#include <QtCore/QDataStream>
+#include <QtCore/QDir>
+#include <QtCore/QSet>
+
+static const qint32 directoryTimesVersion = 1;
+
+// Directories modified this recently may still be changing within the
+// resolution of the file system's timestamps, so their times aren't kept.
+
+static const qint64 settleTime = 2000; // ms
+
+static QString directoryTimesFileName()
+{
+    return KGlobal::dirs()->saveLocation("appdata") + "cache-directories";
+}
+
+static qint64 modificationTime(const QFileInfo &info)
+{
+    return info.lastModified().toMSecsSinceEpoch();
+}
+
+CacheChecker::CacheChecker(const TrackList &tracks, QObject *parent) :
+    QThread(parent),
+    m_done(false),
+    m_stopped(false)
+{
+    foreach(const Track &track, tracks) {
+        const QString directory = track.path.left(track.path.lastIndexOf('/'));
+        m_directories[directory].append(track);
+    }
+}
+
+CacheChecker::~CacheChecker()
+{
+    stop();
+}
+
+void CacheChecker::takeResults(QStringList *missing, QStringList *stale, bool *done)
+{
+    QMutexLocker locker(&m_mutex);
+
+    *missing = m_missing;
+    *stale = m_stale;
+    *done = m_done;
+
+    m_missing.clear();
+    m_stale.clear();
+}
+
+void CacheChecker::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopped = true;
+    }
+
+    wait();
+}
+
+void CacheChecker::run()
+{
+    const DirectoryTimes previousTimes = readDirectoryTimes();
+    const qint64 now = QDateTime::currentMSecsSinceEpoch();
+
+    DirectoryTimes times;
+
+    QHash<QString, TrackList>::ConstIterator it = m_directories.constBegin();
+    for(; it != m_directories.constEnd(); ++it) {
+        const QFileInfo info(it.key());
+        const qint64 time = info.isDir() ? modificationTime(info) : 0;
+
+        if(time != 0 && time < now - settleTime)
+            times.insert(it.key(), time);
+
+        const bool changed = time == 0 || previousTimes.value(it.key(), 0) != time;
+
+        if(!checkDirectory(it.key(), it.value(), changed))
+            return;
+    }
+
+    writeDirectoryTimes(times);
+
+    QMutexLocker locker(&m_mutex);
+    m_done = true;
+}
+
+bool CacheChecker::checkDirectory(const QString &directory, const TrackList &tracks, bool changed)
+{
+    QStringList missing;
+    QStringList stale;
+
+    // Listing a changed directory once finds the files that are gone without
+    // a failed stat for each of them.  The files in an unchanged directory
+    // are all still there.
+
+    QSet<QString> files;
+    if(changed)
+        files = QDir(directory).entryList(QDir::Files | QDir::Hidden | QDir::System).toSet();
+
+    foreach(const Track &track, tracks) {
+        if(changed && !files.contains(track.path.mid(directory.length() + 1))) {
+            missing.append(track.path);
+            continue;
+        }
+
+        const QFileInfo info(track.path);
+
+        if(!info.exists() || !info.isFile())
+            missing.append(track.path);
+        else if(track.modificationTime < modificationTime(info))
+            stale.append(track.path);
+    }
+
+    QMutexLocker locker(&m_mutex);
+
+    m_missing += missing;
+    m_stale += stale;
+
+    if(m_stopped) {
+        m_done = true;
+        return false;
+    }
+
+    return true;
+}
+
+CacheChecker::DirectoryTimes CacheChecker::readDirectoryTimes() const
+{
+    DirectoryTimes times;
+
+    QFile f(directoryTimesFileName());
+    if(!f.open(QIODevice::ReadOnly))
+        return times;
+
+    QDataStream s(&f);
+    s.setVersion(QDataStream::Qt_4_3);
+
+    qint32 version = 0;
+    s >> version;
+
+    if(version != directoryTimesVersion)
+        return times;
+
+    s >> times;
+
+    if(s.status() != QDataStream::Ok) {
+        kWarning() << "Unable to read the directory times of the last cache check";
+        times.clear();
+    }
+
+    return times;
+}
+
+void CacheChecker::writeDirectoryTimes(const DirectoryTimes &times) const
+{
+    KSaveFile f(directoryTimesFileName());
+
+    if(!f.open(QIODevice::WriteOnly)) {
+        kError() << "Error saving directory times:" << f.errorString();
+        return;
+    }
+
+    QDataStream s(&f);
+    s.setVersion(QDataStream::Qt_4_3);
+
+    s << directoryTimesVersion
+      << times;
+
+    f.finalize();
+}
+
+// vim: set et sw=4 tw=0 sta:
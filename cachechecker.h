@@ -0,0 +1,82 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_CACHECHECKER_H
+#define JUK_CACHECHECKER_H
+
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+#include <QtCore/QHash>
+#include <QtCore/QStringList>
+
+/**
+ * Checks the tracks loaded from the music cache against the disk on a worker
+ * thread, so that slow (e.g. network) file systems don't freeze the GUI.
+ *
+ * The tracks are checked a directory at a time.  Files can only have been
+ * added, removed or renamed in a directory if its modification time has
+ * changed, so only those directories are listed to find the missing tracks.
+ * Editing a file in place doesn't change its directory though, so every track
+ * still has its own modification time checked.
+ */
+
+class CacheChecker : public QThread
+{
+public:
+    struct Track
+    {
+        QString path;
+        qint64 modificationTime; // ms since the epoch, as stored in the cache
+    };
+
+    typedef QList<Track> TrackList;
+
+    CacheChecker(const TrackList &tracks, QObject *parent = 0);
+    virtual ~CacheChecker();
+
+    /**
+     * Returns the tracks found to be missing and those found to be out of
+     * date since the last call.  \p done is set to true once these are the
+     * last ones.
+     */
+    void takeResults(QStringList *missing, QStringList *stale, bool *done);
+
+    /**
+     * Asks the checker to stop early and waits for it to do so.
+     */
+    void stop();
+
+protected:
+    virtual void run();
+
+private:
+    typedef QHash<QString, qint64> DirectoryTimes;
+
+    bool checkDirectory(const QString &directory, const TrackList &tracks, bool changed);
+
+    DirectoryTimes readDirectoryTimes() const;
+    void writeDirectoryTimes(const DirectoryTimes &times) const;
+
+    QHash<QString, TrackList> m_directories;
+
+    QMutex m_mutex;
+    QStringList m_missing;
+    QStringList m_stale;
+    bool m_done;
+    bool m_stopped;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
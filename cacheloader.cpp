@@ -0,0 +1,84 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cacheloader.h"
+
+#include <QtCore/QMutexLocker>
+
+#include "cache.h"
+
+// The worker hands tracks over in chunks of this size to keep the time spent
+// holding the lock down.
+
+static const int chunkSize = 64;
+
+CacheLoader::CacheLoader(QObject *parent) :
+    QThread(parent),
+    m_done(false),
+    m_stopped(false)
+{
+}
+
+CacheLoader::~CacheLoader()
+{
+    stop();
+}
+
+FileHandleList CacheLoader::takeLoadedItems(bool *done)
+{
+    QMutexLocker locker(&m_mutex);
+
+    FileHandleList items = m_loadedItems;
+    m_loadedItems.clear();
+    *done = m_done;
+
+    return items;
+}
+
+void CacheLoader::stop()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_stopped = true;
+    }
+
+    wait();
+}
+
+void CacheLoader::run()
+{
+    Cache *cache = Cache::instance();
+    FileHandleList chunk;
+
+    forever {
+        FileHandle item = cache->loadNextCachedItem();
+
+        if(!item.isNull())
+            chunk.append(item);
+
+        if(item.isNull() || chunk.count() == chunkSize) {
+            QMutexLocker locker(&m_mutex);
+
+            m_loadedItems += chunk;
+            chunk.clear();
+
+            if(item.isNull() || m_stopped) {
+                m_done = true;
+                return;
+            }
+        }
+    }
+}
+
+// vim: set et sw=4 tw=0 sta:
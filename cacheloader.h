@@ -0,0 +1,61 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_CACHELOADER_H
+#define JUK_CACHELOADER_H
+
+#include <QtCore/QThread>
+#include <QtCore/QMutex>
+
+#include "filehandle.h"
+
+/**
+ * Reads the tracks from the music cache on a worker thread, so that the GUI
+ * thread only has to create the CollectionListItems for them.
+ *
+ * Cache::prepareToLoadCachedItems() must have been called before the loader
+ * is started, and the Cache should not be used to load items from any other
+ * thread until the loader is finished.
+ */
+
+class CacheLoader : public QThread
+{
+public:
+    CacheLoader(QObject *parent = 0);
+    virtual ~CacheLoader();
+
+    /**
+     * Returns the tracks which have been read since the last call.  \p done
+     * is set to true once the returned items are the last ones.
+     */
+    FileHandleList takeLoadedItems(bool *done);
+
+    /**
+     * Asks the loader to stop early and waits for it to do so.
+     */
+    void stop();
+
+protected:
+    virtual void run();
+
+private:
+    QMutex m_mutex;
+    FileHandleList m_loadedItems;
+    bool m_done;
+    bool m_stopped;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
@@ -24,13 +24,10 @@
 #include <kconfiggroup.h>
 #include <kglobal.h>
 #include <kactioncollection.h>
-#include <ksavefile.h>
-#include <kstandarddirs.h>
 #include <ktoolbarpopupaction.h>
-#include <kdirwatch.h>
 
-#include <QStringBuilder>
 #include <QList>
+#include <QSet>
 #include <QDragMoveEvent>
 #include <QDropEvent>
 #include <QApplication>
@@ -38,12 +35,15 @@
 #include <QTime>
 #include <QClipboard>
 #include <QFileInfo>
+#include <QDateTime>
 
 #include "playlistcollection.h"
 #include "splashscreen.h"
-#include "stringshare.h"
 #include "cache.h"
+#include "cachechecker.h"
+#include "cacheloader.h"
 #include "actioncollection.h"
+#include "pathresolver.h"
 #include "tag.h"
 #include "viewmode.h"
 
@@ -67,6 +67,13 @@ void CollectionList::startLoadingCachedItems()
     if(!m_list)
         return;
 
+    // Keeps juk-indexer from replacing the cache while we're running.  If it
+    // is running right now the cache is still loaded, but our changes aren't
+    // saved to it.
+
+    if(!Cache::instance()->lock())
+        kWarning() << "The music cache is locked by juk-indexer, changes won't be saved to it";
+
     kDebug() << "Starting to load cached items";
     stopwatch.start();
 
@@ -77,36 +84,57 @@ void CollectionList::startLoadingCachedItems()
         return;
     }
 
+    m_cacheLoader = new CacheLoader(this);
+    m_cacheLoader->start();
+
     kDebug() << "Kicked off first batch";
     QTimer::singleShot(0, this, SLOT(loadNextBatchCachedItems()));
 }
 
 void CollectionList::loadNextBatchCachedItems()
 {
-    Cache *cache = Cache::instance();
+    // The tracks themselves are read by m_cacheLoader, here we just create
+    // items for as many of them as fit in our time slice.
+
+    static const int timeBudget = 8; // ms
+
+    QTime timer;
+    timer.start();
+
     bool done = false;
 
-    for(int i = 0; i < 20; ++i) {
-        FileHandle cachedItem(cache->loadNextCachedItem());
+    do {
+        if(m_cachedItems.isEmpty()) {
+            m_cachedItems = m_cacheLoader->takeLoadedItems(&done);
+
+            if(m_cachedItems.isEmpty())
+                break;
 
-        if(cachedItem.isNull()) {
-            done = true;
-            break;
+            done = false;
         }
 
+        FileHandle cachedItem(m_cachedItems.takeFirst());
+
         // This may have already been created via a loaded playlist.
         if(!m_itemsDict.contains(cachedItem.absFilePath())) {
             CollectionListItem *newItem = new CollectionListItem(this, cachedItem);
             setupItem(newItem);
         }
-    }
+    } while(timer.elapsed() < timeBudget);
 
     SplashScreen::update();
 
     if(!done) {
-        QTimer::singleShot(0, this, SLOT(loadNextBatchCachedItems()));
+        // If the loader hasn't caught up with us yet give it a moment instead
+        // of spinning.
+
+        QTimer::singleShot(m_cachedItems.isEmpty() ? 10 : 0,
+                           this, SLOT(loadNextBatchCachedItems()));
     }
     else {
+        delete m_cacheLoader;
+        m_cacheLoader = 0;
+
         completedLoadingCachedItems();
     }
 }
@@ -171,6 +199,7 @@ CollectionListItem *CollectionList::createItem(const FileHandle &file, Q3ListVie
     }
 
     setupItem(item);
+    Cache::instance()->journalUpdate(file);
 
     return item;
 }
@@ -215,6 +244,9 @@ void CollectionList::slotNewItems(const KFileItemList &items)
 void CollectionList::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> > &items)
 {
     for(int i = 0; i < items.count(); ++i) {
+        if(items[i].first.isDir())
+            PathResolver::invalidate(items[i].first.url().path());
+
         const KFileItem fileItem = items[i].second;
         CollectionListItem *item = lookup(fileItem.url().path());
 
@@ -235,45 +267,61 @@ void CollectionList::slotRefreshItems(const QList<QPair<KFileItem, KFileItem> >
 
 void CollectionList::slotDeleteItem(const KFileItem &item)
 {
-    delete lookup(item.url().path());
+    slotDeleteItems(KFileItemList() << item);
 }
 
-void CollectionList::saveItemsToCache() const
+void CollectionList::slotDeleteItems(const KFileItemList &items)
 {
-    kDebug() << "Saving collection list to cache";
+    // A set, since a directory and the files in it may both be reported.
 
-    QString cacheFileName =
-        KGlobal::dirs()->saveLocation("appdata") % QLatin1String("cache");
+    QSet<PlaylistItem *> deleted;
 
-    KSaveFile f(cacheFileName);
+    foreach(const KFileItem &fileItem, items) {
+        const QString path = fileItem.url().path();
 
-    if(!f.open(QIODevice::WriteOnly)) {
-        kError() << "Error saving cache:" << f.errorString();
-        return;
-    }
+        if(!fileItem.isDir()) {
+            CollectionListItem *item = lookup(path);
+            if(item)
+                deleted.insert(item);
+            continue;
+        }
+
+        PathResolver::invalidate(path);
+
+        // Everything that was in a removed directory goes with it.
 
-    QByteArray data;
-    QDataStream s(&data, QIODevice::WriteOnly);
-    s.setVersion(QDataStream::Qt_4_3);
+        const QString prefix = path.endsWith('/') ? path : path + '/';
 
-    QHash<QString, CollectionListItem *>::const_iterator it;
-    for(it = m_itemsDict.begin(); it != m_itemsDict.end(); ++it) {
-        s << it.key();
-        s << (*it)->file();
+        QHash<QString, CollectionListItem *>::ConstIterator it = m_itemsDict.constBegin();
+        for(; it != m_itemsDict.constEnd(); ++it) {
+            if(it.key().startsWith(prefix))
+                deleted.insert(it.value());
+        }
     }
 
-    QDataStream fs(&f);
+    if(!deleted.isEmpty())
+        clearItems(deleted.toList());
+}
+
+void CollectionList::saveItemsToCache() const
+{
+    Cache *cache = Cache::instance();
+
+    // Changes made since the cache was loaded are already in the journal, so
+    // the cache only needs to be rewritten once the journal gets large.
 
-    qint32 checksum = qChecksum(data.data(), data.size());
+    if(cache->isLocked() && cache->journalNeedsCompaction()) {
+        kDebug() << "Saving collection list to cache";
 
-    fs << qint32(Cache::playlistItemsCacheVersion)
-       << checksum
-       << data;
+        FileHandleList files;
+        foreach(const CollectionListItem *item, m_itemsDict)
+            files.append(item->file());
 
-    f.close();
+        if(Cache::saveCachedItems(files))
+            cache->discardJournal();
+    }
 
-    if(!f.finalize())
-        kError() << "Error saving cache:" << f.errorString();
+    cache->closeJournal();
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -301,19 +349,70 @@ void CollectionList::clear()
 
 void CollectionList::slotCheckCache()
 {
-    PlaylistItemList invalidItems;
+    if(m_cacheChecker)
+        return;
+
     kDebug() << "Starting to check cached items for consistency";
     stopwatch.start();
 
-    int i = 0;
-    foreach(CollectionListItem *item, m_itemsDict) {
-        if(!item->checkCurrent())
+    // Only the paths and times go to the checker, the items themselves
+    // mustn't be touched outside of the GUI thread.
+
+    CacheChecker::TrackList tracks;
+
+    QHash<QString, CollectionListItem *>::ConstIterator it = m_itemsDict.constBegin();
+    for(; it != m_itemsDict.constEnd(); ++it) {
+        const QDateTime modificationTime = it.value()->file().modificationTime();
+
+        CacheChecker::Track track;
+        track.path = it.key();
+        track.modificationTime =
+            modificationTime.isValid() ? modificationTime.toMSecsSinceEpoch() : 0;
+
+        tracks.append(track);
+    }
+
+    m_cacheChecker = new CacheChecker(tracks, this);
+    m_cacheChecker->start(QThread::LowestPriority);
+
+    QTimer::singleShot(100, this, SLOT(processCacheCheckResults()));
+}
+
+void CollectionList::processCacheCheckResults()
+{
+    if(!m_cacheChecker)
+        return;
+
+    QStringList missing;
+    QStringList stale;
+    bool done = false;
+
+    m_cacheChecker->takeResults(&missing, &stale, &done);
+
+    PlaylistItemList invalidItems;
+
+    foreach(const QString &file, missing) {
+        CollectionListItem *item = m_itemsDict.value(file);
+        if(item)
             invalidItems.append(item);
-        if(++i == (m_itemsDict.size() / 2))
-            kDebug() << "Checkpoint";
     }
 
-    clearItems(invalidItems);
+    foreach(const QString &file, stale) {
+        CollectionListItem *item = m_itemsDict.value(file);
+        if(item && !item->checkCurrent())
+            invalidItems.append(item);
+    }
+
+    if(!invalidItems.isEmpty())
+        clearItems(invalidItems);
+
+    if(!done) {
+        QTimer::singleShot(100, this, SLOT(processCacheCheckResults()));
+        return;
+    }
+
+    delete m_cacheChecker;
+    m_cacheChecker = 0;
 
     kDebug() << "Finished consistency check, took" << stopwatch.elapsed() << "ms";
 }
@@ -335,6 +434,8 @@ void CollectionList::slotRefreshItem(const QString &file)
 
 CollectionList::CollectionList(PlaylistCollection *collection) :
     Playlist(collection, true),
+    m_cacheLoader(0),
+    m_cacheChecker(0),
     m_columnTags(15, 0)
 {
     QAction *spaction = ActionCollection::actions()->addAction("showPlaying");
@@ -354,6 +455,9 @@ CollectionList::CollectionList(PlaylistCollection *collection) :
 
 CollectionList::~CollectionList()
 {
+    delete m_cacheLoader;
+    delete m_cacheChecker;
+
     KConfigGroup config(KGlobal::config(), "Playlists");
     config.writeEntry("CollectionListSortColumn", sortColumn());
     config.writeEntry("CollectionListSortAscending", sortOrder() == Qt::AscendingOrder);
@@ -366,8 +470,11 @@ CollectionList::~CollectionList()
 
     // The CollectionListItems will try to remove themselves from the
     // m_columnTags member, so we must make sure they're gone before we
-    // are.
+    // are.  There's no point in keeping the search and album indexes up to
+    // date while they do.
 
+    m_searchIndex.clear();
+    m_albumIndex.clear();
     clearItems(items());
 
     qDeleteAll(m_columnTags);
@@ -448,14 +555,18 @@ void CollectionList::removeStringFromDict(const QString &value, int column)
     }
 }
 
-void CollectionList::addWatched(const QString &file)
+void CollectionList::addToSearchIndex(CollectionListItem *item)
 {
-    m_dirWatch->addFile(file);
-}
+    QStringList keys;
 
-void CollectionList::removeWatched(const QString &file)
-{
-    m_dirWatch->removeFile(file);
+    for(int column = 0; column < PlaylistItem::FileNameColumn; ++column) {
+        if(SearchIndex::isIndexed(column))
+            keys.append(item->searchKey(column + columnOffset(), true));
+        else
+            keys.append(QString());
+    }
+
+    m_searchIndex.insert(item, keys);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -467,40 +578,49 @@ void CollectionListItem::refresh()
     int offset = CollectionList::instance()->columnOffset();
     int columns = lastColumn() + offset + 1;
 
-    data()->metadata.resize(columns);
-    data()->cachedWidths.resize(columns);
+    // New items aren't counted in the column weights until they're set up.
 
-    for(int i = offset; i < columns; i++) {
-        int id = i - offset;
-        if(id != TrackNumberColumn && id != LengthColumn) {
-            // All columns other than track num and length need local-encoded data for sorting
+    const bool widthsCounted = data()->cachedWidths.size() == columns;
 
-            QString toLower = text(i).toLower();
+    data()->cachedWidths.resize(columns);
 
-            // For some columns, we may be able to share some strings
+    // The sort and search keys are kept with the strings in the TrackStore, so
+    // all that's left to update here are the tag lists and the column widths.
 
-            if((id == ArtistColumn) || (id == AlbumColumn) ||
-               (id == GenreColumn)  || (id == YearColumn)  ||
-               (id == CommentColumn))
-            {
-                toLower = StringShare::tryShare(toLower);
+    static const int listedColumns[] = { ArtistColumn, AlbumColumn, GenreColumn };
 
-                if(id != YearColumn && id != CommentColumn && data()->metadata[id] != toLower) {
-                    CollectionList::instance()->removeStringFromDict(data()->metadata[id], id);
-                    CollectionList::instance()->addStringToDict(text(i), id);
-                }
-            }
+    for(int i = 0; i < 3; i++) {
+        const QString value = text(listedColumns[i] + offset);
 
-            data()->metadata[id] = toLower;
+        if(value != data()->listedTags[i]) {
+            CollectionList::instance()->removeStringFromDict(data()->listedTags[i], listedColumns[i]);
+            CollectionList::instance()->addStringToDict(value, listedColumns[i]);
+            data()->listedTags[i] = value;
         }
+    }
 
+    for(int i = offset; i < columns; i++) {
+        int id = i - offset;
         int newWidth = width(listView()->fontMetrics(), listView(), i);
-        if(newWidth != data()->cachedWidths[i])
-            playlist()->slotWeightDirty(i);
+        if(newWidth != data()->cachedWidths[i]) {
+            if(widthsCounted) {
+                playlist()->updateColumnWidth(i, data()->cachedWidths[i], newWidth);
+
+                foreach(PlaylistItem *child, m_children) {
+                    child->playlist()->updateColumnWidth(id + child->playlist()->columnOffset(),
+                                                         data()->cachedWidths[i], newWidth);
+                }
+            }
+            else
+                playlist()->slotWeightDirty(i);
+        }
 
         data()->cachedWidths[i] = newWidth;
     }
 
+    CollectionList::instance()->addToSearchIndex(this);
+    CollectionList::instance()->addToAlbumIndex(this);
+
     if(listView()->isVisible())
         repaint();
 
@@ -512,6 +632,7 @@ void CollectionListItem::refresh()
     }
 
     CollectionList::instance()->dataChanged();
+    emit CollectionList::instance()->signalItemRefreshed(this);
     emit CollectionList::instance()->signalCollectionChanged();
 }
 
@@ -536,6 +657,8 @@ void CollectionListItem::updateCollectionDict(const QString &oldPath, const QStr
 
     collection->removeFromDict(oldPath);
     collection->addToDict(newPath, this);
+
+    Cache::instance()->journalRename(oldPath, newPath);
 }
 
 void CollectionListItem::repaint() const
@@ -577,10 +700,13 @@ CollectionListItem::~CollectionListItem()
 
     CollectionList *l = CollectionList::instance();
     if(l) {
+        Cache::instance()->journalRemove(file().absFilePath());
         l->removeFromDict(file().absFilePath());
-        l->removeStringFromDict(file().tag()->album(), AlbumColumn);
-        l->removeStringFromDict(file().tag()->artist(), ArtistColumn);
-        l->removeStringFromDict(file().tag()->genre(), GenreColumn);
+        l->removeFromSearchIndex(this);
+        l->removeFromAlbumIndex(this);
+        l->removeStringFromDict(data()->listedTags[0], ArtistColumn);
+        l->removeStringFromDict(data()->listedTags[1], AlbumColumn);
+        l->removeStringFromDict(data()->listedTags[2], GenreColumn);
     }
 }
 
@@ -603,6 +729,7 @@ bool CollectionListItem::checkCurrent()
     if(!file().current()) {
         file().refresh();
         refresh();
+        Cache::instance()->journalUpdate(file());
     }
 
     return true;
@@ -22,11 +22,14 @@
 
 #include "playlist.h"
 #include "playlistitem.h"
+#include "albumindex.h"
+#include "searchindex.h"
 
 class ViewMode;
 class KFileItem;
 class KFileItemList;
-class KDirWatch;
+class CacheChecker;
+class CacheLoader;
 
 /**
  * This type is for mapping QString track attributes like the album, artist
@@ -126,6 +129,18 @@ public:
 
     void saveItemsToCache() const;
 
+    /**
+     * The index of the words and trigrams in the items' text, which is used to
+     * speed up searching.
+     */
+    const SearchIndex &searchIndex() const { return m_searchIndex; }
+
+    /**
+     * The tracks of each album in track order, which is used by album random
+     * play and to find the tracks sharing an album's cover.
+     */
+    const AlbumIndex &albumIndex() const { return m_albumIndex; }
+
 public slots:
     virtual void paste();
     virtual void clear();
@@ -137,6 +152,7 @@ public slots:
     void slotNewItems(const KFileItemList &items);
     void slotRefreshItems(const QList<QPair<KFileItem, KFileItem> > &items);
     void slotDeleteItem(const KFileItem &item);
+    void slotDeleteItems(const KFileItemList &items);
 
 protected:
     CollectionList(PlaylistCollection *collection);
@@ -150,20 +166,29 @@ protected:
     void addToDict(const QString &file, CollectionListItem *item) { m_itemsDict.insert(file, item); }
     void removeFromDict(const QString &file) { m_itemsDict.remove(file); }
 
+    void addToSearchIndex(CollectionListItem *item);
+    void removeFromSearchIndex(CollectionListItem *item) { m_searchIndex.remove(item); }
+
+    void addToAlbumIndex(CollectionListItem *item) { m_albumIndex.insert(item); }
+    void removeFromAlbumIndex(CollectionListItem *item) { m_albumIndex.remove(item); }
+
     // These methods are also used by CollectionListItem, to manage the
     // strings used in generating the unique sets and tree view mode playlists.
 
     QString addStringToDict(const QString &value, int column);
     void removeStringFromDict(const QString &value, int column);
 
-    void addWatched(const QString &file);
-    void removeWatched(const QString &file);
-
     virtual bool hasItem(const QString &file) const { return m_itemsDict.contains(file); }
 
 signals:
     void signalCollectionChanged();
 
+    /**
+     * This is emitted when the tags of \a item have been (re)read, which also
+     * happens as new items are created.
+     */
+    void signalItemRefreshed(CollectionListItem *item);
+
     /**
      * This is emitted when the set of columns that is visible is changed.
      *
@@ -187,7 +212,8 @@ public slots:
     void startLoadingCachedItems();
 
     /**
-     * Loads a few items at a time. Intended to be single-shotted into the event
+     * Creates items for the tracks read so far by the cache loader, for a
+     * few milliseconds at a time. Intended to be single-shotted into the event
      * loop so that loading the music doesn't freeze the GUI.
      */
     void loadNextBatchCachedItems();
@@ -198,6 +224,13 @@ public slots:
      */
     void completedLoadingCachedItems();
 
+    /**
+     * Removes or refreshes the items that the cache checker has found to be
+     * missing or out of date so far.  Reschedules itself until the check is
+     * complete.
+     */
+    void processCacheCheckResults();
+
 private:
     /**
      * Just the size of the above enum to keep from hard coding it in several
@@ -207,8 +240,12 @@ private:
 
     static CollectionList *m_list;
     QHash<QString, CollectionListItem *> m_itemsDict;
-    KDirWatch *m_dirWatch;
+    CacheLoader *m_cacheLoader;
+    CacheChecker *m_cacheChecker;
+    FileHandleList m_cachedItems;
     TagCountDicts m_columnTags;
+    SearchIndex m_searchIndex;
+    AlbumIndex m_albumIndex;
 };
 
 #endif
@@ -49,7 +49,6 @@
 
 #include "mediafiles.h"
 #include "collectionlist.h"
-#include "playlistsearch.h"
 #include "playlistitem.h"
 #include "tag.h"
 
@@ -168,35 +167,17 @@ void CoverInfo::setCoverId(coverKey id)
 
 void CoverInfo::applyCoverToWholeAlbum(bool overwriteExistingCovers) const
 {
-    QString artist = m_file.tag()->artist();
-    QString album = m_file.tag()->album();
-    PlaylistSearch::ComponentList components;
-    ColumnList columns;
+    const AlbumIndex::ItemList tracks = CollectionList::instance()->albumIndex().tracks(
+        m_file.tag()->artist(), m_file.tag()->album());
 
-    columns.append(PlaylistItem::ArtistColumn);
-    components.append(PlaylistSearch::Component(artist, false, columns, PlaylistSearch::Component::Exact));
-
-    columns.clear();
-    columns.append(PlaylistItem::AlbumColumn);
-    components.append(PlaylistSearch::Component(album, false, columns, PlaylistSearch::Component::Exact));
-
-    PlaylistList playlists;
-    playlists.append(CollectionList::instance());
-
-    PlaylistSearch search(playlists, components, PlaylistSearch::MatchAll);
-
-    // Search done, iterate through results.
-
-    PlaylistItemList results = search.matchedItems();
-    PlaylistItemList::ConstIterator it = results.constBegin();
-    for(; it != results.constEnd(); ++it) {
+    foreach(const CollectionListItem *item, tracks) {
 
         // Don't worry about files that somehow already have a tag,
         // unless the conversion is forced.
-        if(!overwriteExistingCovers && (*it)->file().coverInfo()->coverId() != CoverManager::NoMatch)
+        if(!overwriteExistingCovers && item->file().coverInfo()->coverId() != CoverManager::NoMatch)
             continue;
 
-        (*it)->file().coverInfo()->setCoverId(m_coverKey);
+        item->file().coverInfo()->setCoverId(m_coverKey);
     }
 }
 
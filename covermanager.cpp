@@ -27,6 +27,8 @@
 #include <QPixmapCache>
 #include <QByteArray>
 #include <QMap>
+#include <QPair>
+#include <QtAlgorithms>
 
 #include <kdebug.h>
 #include <ktemporaryfile.h>
@@ -44,6 +46,11 @@
 // of users who upgrade, and would just generally be a big mess.
 typedef QHash<QString, coverKey> TrackLookupMap;
 
+// Maps the lowercased artist and album of the covers to their ids, in
+// increasing order, for looking covers up by the metadata of a track.
+typedef QPair<QString, QString> CoverMetadata;
+typedef QHash<CoverMetadata, CoverList> MetadataLookupMap;
+
 static const char dragMimetype[] = "application/x-juk-coverid";
 
 const coverKey CoverManager::NoMatch = 0;
@@ -111,6 +118,9 @@ public:
     /// Maps file names to coverKey id's.
     TrackLookupMap tracks;
 
+    /// Maps artist and album to the coverKey id's of the matching covers.
+    MetadataLookupMap metadata;
+
     /// A map of outstanding download KJobs to their coverKey
     QMap<KJob*, coverKey> downloadJobs;
 
@@ -119,7 +129,7 @@ public:
     /// 't' followed by the pathname for Thumbnail covers.
     /// However only thumbnails are currently cached.
 
-    CoverManagerPrivate() : m_timer(new CoverSaveHelper(0)), m_coverProxy(0)
+    CoverManagerPrivate() : m_timer(new CoverSaveHelper(0)), m_coverProxy(0), m_lastId(0)
     {
         loadCovers();
     }
@@ -150,6 +160,23 @@ public:
      */
     coverKey nextId() const;
 
+    /**
+     * Adds @p data to the covers under @p id, which should be the one
+     * returned by nextId() for new covers.
+     */
+    void insertCover(coverKey id, CoverDataPtr data);
+
+    /**
+     * Forgets the cover with the given @p id, which may then be reused.
+     */
+    void eraseCover(coverKey id);
+
+    /**
+     * @return the id of the first cover for @p album by @p artist, or
+     * CoverManager::NoMatch if there is none.
+     */
+    coverKey idFromMetadata(const QString &artist, const QString &album) const;
+
     void saveCovers() const;
 
     CoverProxy *coverProxy() {
@@ -167,9 +194,16 @@ public:
      */
     QString coverLocation() const;
 
+    static CoverMetadata metadataKey(const QString &artist, const QString &album);
+
     CoverSaveHelper *m_timer;
 
     CoverProxy *m_coverProxy;
+
+    /// The ids below m_lastId that aren't in use, so that they're reused
+    /// before new ones are handed out.
+    CoverList m_freeIds;
+    coverKey m_lastId;
 };
 
 // This is responsible for making sure that the CoverManagerPrivate class
@@ -261,7 +295,7 @@ void CoverManagerPrivate::loadCovers()
         in >> *data;
         data->refCount = 0;
 
-        covers[(coverKey) id] = data;
+        insertCover((coverKey) id, data);
     }
 
     in >> count;
@@ -290,18 +324,65 @@ QString CoverManagerPrivate::coverLocation() const
     return KGlobal::dirs()->saveLocation("appdata") + "coverdb/covers";
 }
 
-// XXX: This could probably use some improvement, I don't like the linear
-// search for ID idea.  Linear search is used instead of covers.size() since we want to
-// re-use old IDs if possible.
 coverKey CoverManagerPrivate::nextId() const
 {
-    // Start from 1...
-    coverKey key = 1;
+    if(!m_freeIds.isEmpty())
+        return m_freeIds.last();
+
+    return m_lastId + 1;
+}
+
+void CoverManagerPrivate::insertCover(coverKey id, CoverDataPtr data)
+{
+    if(!m_freeIds.isEmpty() && m_freeIds.last() == id)
+        m_freeIds.removeLast();
+    else if(id > m_lastId) {
+        // Any ids skipped over are free.  Ids are loaded in increasing
+        // order, so this is where the gaps in them are found.
+
+        for(coverKey freeId = id - 1; freeId > m_lastId; --freeId)
+            m_freeIds.append(freeId);
+
+        m_lastId = id;
+    }
+    else
+        m_freeIds.removeOne(id);
+
+    covers.insert(id, data);
+
+    CoverList &ids = metadata[metadataKey(data->artist, data->album)];
+    ids.insert(qLowerBound(ids.begin(), ids.end(), id), id);
+}
+
+void CoverManagerPrivate::eraseCover(coverKey id)
+{
+    CoverDataPtr data = covers.take(id);
+    if(!data)
+        return;
+
+    MetadataLookupMap::Iterator it = metadata.find(metadataKey(data->artist, data->album));
+    if(it != metadata.end()) {
+        it.value().removeOne(id);
+        if(it.value().isEmpty())
+            metadata.erase(it);
+    }
+
+    m_freeIds.append(id);
+}
+
+coverKey CoverManagerPrivate::idFromMetadata(const QString &artist, const QString &album) const
+{
+    const CoverList ids = metadata.value(metadataKey(artist, album));
+
+    if(ids.isEmpty())
+        return CoverManager::NoMatch;
 
-    while(covers.contains(key))
-        ++key;
+    return ids.first();
+}
 
-    return key;
+CoverMetadata CoverManagerPrivate::metadataKey(const QString &artist, const QString &album)
+{
+    return qMakePair(artist.toLower(), album.toLower());
 }
 
 //
@@ -344,17 +425,7 @@ const char *CoverDrag::mimetype()
 //
 coverKey CoverManager::idFromMetadata(const QString &artist, const QString &album)
 {
-    // Search for the string, yay!  It might make sense to use a cache here,
-    // if so it's not hard to add a QCache.
-    CoverDataMap::const_iterator it = begin();
-    CoverDataMap::const_iterator endIt = end();
-
-    for(; it != endIt; ++it) {
-        if(it.value()->album == album.toLower() && it.value()->artist == artist.toLower())
-            return it.key();
-    }
-
-    return NoMatch;
+    return data()->idFromMetadata(artist, album);
 }
 
 QPixmap CoverManager::coverFromId(coverKey id, Size size)
@@ -458,7 +529,7 @@ coverKey CoverManager::addCover(const KUrl &path, const QString &artist, const Q
     coverData->album = album.toLower();
     coverData->refCount = 0;
 
-    data()->covers[id] = coverData;
+    data()->insertCover(id, coverData);
 
     // Can't use NetAccess::download() since if path is already a local file
     // (which is possible) then that function will return without copying, since
@@ -540,7 +611,7 @@ bool CoverManager::removeCover(coverKey id)
     QFile::remove(coverData->path);
 
     // Finally, forget that we ever knew about this cover.
-    data()->covers.remove(id);
+    data()->eraseCover(id);
     data()->requestSave();
 
     return true;
@@ -0,0 +1,46 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_CRC32C_H
+#define JUK_CRC32C_H
+
+#include <QtCore/QtGlobal>
+
+/**
+ * Returns the CRC32C (Castagnoli) checksum of \p length bytes at \p data.
+ * Unlike qChecksum() this is strong enough to trust with hundreds of
+ * megabytes, and most x86 CPUs can compute it in hardware, which is used
+ * when available.
+ */
+quint32 crc32c(const void *data, quint64 length);
+
+/**
+ * The table driven implementation of crc32c(), which works everywhere.
+ */
+quint32 crc32cSoftware(const void *data, quint64 length);
+
+/**
+ * Returns true if the CPU has the SSE4.2 crc32 instruction.
+ */
+bool crc32cHardwareAvailable();
+
+/**
+ * crc32c() using the SSE4.2 crc32 instruction.  Only to be called if
+ * crc32cHardwareAvailable() returns true.
+ */
+quint32 crc32cHardware(const void *data, quint64 length);
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
@@ -0,0 +1,242 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "directorywatcher.h"
+
+#include <kdirwatch.h>
+#include <kurl.h>
+#include <kdebug.h>
+
+#include <QTimer>
+#include <QFileInfo>
+#include <QDirIterator>
+
+#include <sys/stat.h>
+
+#include "foldertrie.h"
+#include "pathresolver.h"
+
+// Changes are reported once nothing else has happened for settleTime ms, but
+// no later than maximumDelay ms after the first one so that a long running
+// copy still shows up as it goes.
+
+static const int settleTime = 500;
+static const int maximumDelay = 3000;
+
+static bool isBelow(const QString &path, const QString &directory)
+{
+    return path.startsWith(directory) &&
+        (path.length() == directory.length() || path.at(directory.length()) == '/');
+}
+
+// Folders are watched under their canonical path, which is what the FolderTrie
+// expects.
+
+static QString watchedPath(const QString &folder)
+{
+    const QString canonicalPath = PathResolver::canonicalFilePath(folder);
+    return canonicalPath.isEmpty() ? QFileInfo(folder).absoluteFilePath() : canonicalPath;
+}
+
+static KFileItem fileItem(const QString &path, bool isDirectory = false)
+{
+    return KFileItem(isDirectory ? S_IFDIR : KFileItem::Unknown, KFileItem::Unknown,
+                     KUrl::fromPath(path));
+}
+
+DirectoryWatcher::DirectoryWatcher(QObject *parent) :
+    QObject(parent),
+    m_dirWatch(new KDirWatch(this)),
+    m_folderTrie(0),
+    m_timer(new QTimer(this)),
+    m_paused(false)
+{
+    m_timer->setSingleShot(true);
+
+    connect(m_timer, SIGNAL(timeout()), SLOT(slotEmitChanges()));
+
+    connect(m_dirWatch, SIGNAL(created(QString)), SLOT(slotCreated(QString)));
+    connect(m_dirWatch, SIGNAL(dirty(QString)), SLOT(slotDirty(QString)));
+    connect(m_dirWatch, SIGNAL(deleted(QString)), SLOT(slotDeleted(QString)));
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+}
+
+void DirectoryWatcher::setFolderTrie(const FolderTrie *folderTrie)
+{
+    m_folderTrie = folderTrie;
+}
+
+void DirectoryWatcher::addFolder(const QString &folder)
+{
+    QStringList directories(watchedPath(folder));
+
+    // Symlinks are skipped since they could lead back up the tree.
+
+    while(!directories.isEmpty()) {
+        const QString directory = directories.takeLast();
+
+        if(m_folderTrie && m_folderTrie->isExcluded(directory))
+            continue;
+
+        addDirectory(directory);
+
+        QDirIterator it(directory, QDir::Dirs | QDir::NoDotAndDotDot | QDir::NoSymLinks);
+        while(it.hasNext())
+            directories.append(it.next());
+    }
+}
+
+void DirectoryWatcher::removeFolder(const QString &folder)
+{
+    const QString directory = watchedPath(folder);
+
+    foreach(const QString &watched, m_directories) {
+        if(isBelow(watched, directory))
+            removeDirectory(watched);
+    }
+}
+
+void DirectoryWatcher::removeExcludedDirectories()
+{
+    if(!m_folderTrie)
+        return;
+
+    foreach(const QString &watched, m_directories) {
+        if(m_folderTrie->isExcluded(watched))
+            removeDirectory(watched);
+    }
+}
+
+void DirectoryWatcher::setPaused(bool paused)
+{
+    m_paused = paused;
+
+    if(paused)
+        m_timer->stop();
+    else if(!m_created.isEmpty() || !m_changed.isEmpty() || !m_deleted.isEmpty())
+        scheduleChanges();
+}
+
+void DirectoryWatcher::slotCreated(const QString &path)
+{
+    // A new directory (e.g. a copied album) is passed on as a whole, adding
+    // it to the collection scans its contents.  One that replaces a directory
+    // deleted in the same batch has different contents, so it's reported as
+    // deleted and created again rather than as changed.
+
+    if(QFileInfo(path).isDir()) {
+        addFolder(path);
+        m_created.insert(path);
+    }
+    else if(m_deleted.remove(path))
+        m_changed.insert(path);
+    else
+        m_created.insert(path);
+
+    scheduleChanges();
+}
+
+void DirectoryWatcher::slotDirty(const QString &path)
+{
+    // The directories themselves are dirty whenever an entry in them comes or
+    // goes, which is reported separately.
+
+    if(m_directories.contains(path) || m_created.contains(path))
+        return;
+
+    m_changed.insert(path);
+    scheduleChanges();
+}
+
+void DirectoryWatcher::slotDeleted(const QString &path)
+{
+    if(m_directories.contains(path)) {
+        removeFolder(path);
+        m_deletedDirectories.insert(path);
+    }
+
+    m_changed.remove(path);
+
+    if(!m_created.remove(path))
+        m_deleted.insert(path);
+
+    scheduleChanges();
+}
+
+void DirectoryWatcher::slotEmitChanges()
+{
+    KFileItemList created;
+    QList<QPair<KFileItem, KFileItem> > changed;
+    KFileItemList deleted;
+
+    foreach(const QString &path, m_created)
+        created.append(fileItem(path));
+
+    foreach(const QString &path, m_changed) {
+        const KFileItem item = fileItem(path);
+        changed.append(qMakePair(item, item));
+    }
+
+    foreach(const QString &path, m_deleted)
+        deleted.append(fileItem(path, m_deletedDirectories.contains(path)));
+
+    m_created.clear();
+    m_changed.clear();
+    m_deleted.clear();
+    m_deletedDirectories.clear();
+
+    kDebug() << "Reporting" << created.count() << "new," << changed.count()
+             << "changed and" << deleted.count() << "deleted files";
+
+    if(!deleted.isEmpty())
+        emit deleteItems(deleted);
+    if(!changed.isEmpty())
+        emit refreshItems(changed);
+    if(!created.isEmpty())
+        emit newItems(created);
+}
+
+void DirectoryWatcher::addDirectory(const QString &directory)
+{
+    if(m_directories.contains(directory))
+        return;
+
+    m_directories.insert(directory);
+    m_dirWatch->addDir(directory, KDirWatch::WatchFiles);
+}
+
+void DirectoryWatcher::removeDirectory(const QString &directory)
+{
+    if(m_directories.remove(directory))
+        m_dirWatch->removeDir(directory);
+}
+
+void DirectoryWatcher::scheduleChanges()
+{
+    if(m_paused)
+        return;
+
+    if(!m_timer->isActive())
+        m_firstChange.start();
+
+    const int remaining = maximumDelay - m_firstChange.elapsed();
+    m_timer->start(qBound(0, remaining, settleTime));
+}
+
+#include "directorywatcher.moc"
+
+// vim: set et sw=4 tw=0 sta:
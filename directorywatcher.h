@@ -0,0 +1,109 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_DIRECTORYWATCHER_H
+#define JUK_DIRECTORYWATCHER_H
+
+#include <kfileitem.h>
+
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTime>
+#include <QPair>
+
+class QTimer;
+class KDirWatch;
+class FolderTrie;
+
+/**
+ * Watches the music folders, including all of their subdirectories, for
+ * changes.  Only the directories are registered with the system, the files in
+ * them are covered by their directory's watch.
+ *
+ * Directories which the FolderTrie given to setFolderTrie() excludes aren't
+ * watched, nor is anything below them.
+ *
+ * Changes are collected for a moment before being reported, so that e.g.
+ * retagging or copying a whole album results in one batch of each kind
+ * instead of a signal per file.
+ */
+class DirectoryWatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit DirectoryWatcher(QObject *parent = 0);
+    virtual ~DirectoryWatcher();
+
+    /**
+     * Sets the folders that are left out when walking the watched folders.
+     * \p folderTrie has to outlive the watcher.
+     */
+    void setFolderTrie(const FolderTrie *folderTrie);
+
+    /**
+     * Starts watching \p folder and everything below it that isn't excluded.
+     */
+    void addFolder(const QString &folder);
+
+    /**
+     * Stops watching \p folder and everything below it.
+     */
+    void removeFolder(const QString &folder);
+
+    /**
+     * Stops watching the directories that have been excluded since they were
+     * added.
+     */
+    void removeExcludedDirectories();
+
+    /**
+     * While paused, changes are still collected but not reported until
+     * watching is resumed.
+     */
+    void setPaused(bool paused);
+
+signals:
+    void newItems(const KFileItemList &items);
+    void refreshItems(const QList<QPair<KFileItem, KFileItem> > &items);
+    void deleteItems(const KFileItemList &items);
+
+private slots:
+    void slotCreated(const QString &path);
+    void slotDirty(const QString &path);
+    void slotDeleted(const QString &path);
+    void slotEmitChanges();
+
+private:
+    void addDirectory(const QString &directory);
+    void removeDirectory(const QString &directory);
+    void scheduleChanges();
+
+    KDirWatch *m_dirWatch;
+    const FolderTrie *m_folderTrie;
+    QTimer *m_timer;
+    QTime m_firstChange;
+    bool m_paused;
+
+    QSet<QString> m_directories;
+    QSet<QString> m_created;
+    QSet<QString> m_changed;
+    QSet<QString> m_deleted;
+    QSet<QString> m_deletedDirectories;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
@@ -51,7 +51,7 @@ public slots:
      * associated with the dynamic list.
      */
     virtual void slotReload();
-    void slotSetDirty() { m_dirty = true; }
+    virtual void slotSetDirty() { m_dirty = true; }
 
     /**
      * This is called when lowering the widget from the widget stack so that
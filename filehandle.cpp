@@ -19,14 +19,15 @@
 #include <kdebug.h>
 
 #include <QFileInfo>
-
-#include <limits.h>
-#include <stdlib.h>
+#include <QDateTime>
+#include <QAtomicInt>
+#include <QtConcurrentMap>
 
 #include "filehandleproperties.h"
 #include "tag.h"
 #include "cache.h"
 #include "coverinfo.h"
+#include "pathresolver.h"
 
 AddProperty(Title, tag()->title())
 AddProperty(Artist, tag()->artist())
@@ -41,37 +42,53 @@ AddProperty(Path, absFilePath())
 AddNumberProperty(Size, fileInfo().size())
 AddProperty(Extension, fileInfo().suffix())
 
-static QString resolveSymLinks(const QFileInfo &file) // static
+static void readTag(FileHandle &file)
 {
-    char real[PATH_MAX];
+    file.tag();
+}
 
-    if(file.exists() && realpath(QFile::encodeName(file.absoluteFilePath()).data(), real))
-        return QFile::decodeName(real);
-    else
-        return file.filePath();
+static QString resolveSymLinks(const QFileInfo &file) // static
+{
+    const QString canonicalPath = PathResolver::canonicalFilePath(file.absoluteFilePath());
+    return canonicalPath.isEmpty() ? file.filePath() : canonicalPath;
 }
 
 /**
- * A simple reference counter -- pasted from TagLib.
+ * A simple reference counter -- pasted from TagLib.  Atomic since FileHandles
+ * are handed over from the cache loading thread.
  */
 
 class RefCounter
 {
 public:
     RefCounter() : refCount(1) {}
-    void ref() { refCount++; }
-    bool deref() { return ! --refCount ; }
+    void ref() { refCount.ref(); }
+    bool deref() { return !refCount.deref(); }
     int count() const { return refCount; }
 private:
-    uint refCount;
+    QAtomicInt refCount;
 };
 
+/**
+ * Timestamps are kept as milliseconds since the epoch rather than as
+ * QDateTimes, each of which would cost another heap allocation per track.
+ */
+
+static const qint64 invalidTime = Q_INT64_C(-0x7fffffffffffffff) - 1;
+
+static qint64 timeFromDateTime(const QDateTime &dateTime)
+{
+    return dateTime.isValid() ? dateTime.toMSecsSinceEpoch() : invalidTime;
+}
+
 class FileHandle::FileHandlePrivate : public RefCounter
 {
 public:
     FileHandlePrivate() :
         tag(0),
-        coverInfo(0) {}
+        coverInfo(0),
+        modificationTime(invalidTime),
+        lastModified(invalidTime) {}
 
     ~FileHandlePrivate()
     {
@@ -83,8 +100,8 @@ public:
     mutable CoverInfo *coverInfo;
     mutable QString absFilePath;
     QFileInfo fileInfo;
-    QDateTime modificationTime;
-    QDateTime lastModified;
+    qint64 modificationTime;
+    mutable qint64 lastModified;
 };
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -132,6 +149,15 @@ FileHandle::FileHandle(const QString &path, CacheDataStream &s)
     read(s);
 }
 
+FileHandle::FileHandle(const QString &path, Tag *tag, const QDateTime &modificationTime)
+{
+    d = new FileHandlePrivate;
+    d->fileInfo = QFileInfo(path);
+    d->absFilePath = path;
+    d->tag = tag;
+    d->modificationTime = timeFromDateTime(modificationTime);
+}
+
 FileHandle::~FileHandle()
 {
     if(d->deref())
@@ -168,6 +194,11 @@ void FileHandle::setFile(const QString &path)
 
 Tag *FileHandle::tag() const
 {
+    // Tracks which are opened before the collection has been loaded (e.g.
+    // from the command line) can usually still be found in the cache.
+
+    if(!d->tag)
+        d->tag = Cache::instance()->cachedTag(*this);
     if(!d->tag)
         d->tag = new Tag(d->absFilePath);
 
@@ -176,10 +207,15 @@ Tag *FileHandle::tag() const
 
 CoverInfo *FileHandle::coverInfo() const
 {
+#ifdef JUK_INDEXER
+    // The indexer doesn't link the cover management, which needs the GUI.
+    return 0;
+#else
     if(!d->coverInfo)
         d->coverInfo = new CoverInfo(*this);
 
     return d->coverInfo;
+#endif
 }
 
 QString FileHandle::absFilePath() const
@@ -201,21 +237,37 @@ bool FileHandle::isNull() const
 
 bool FileHandle::current() const
 {
-    return (d->modificationTime.isValid() &&
-            lastModified().isValid() &&
-            d->modificationTime >= lastModified());
+    if(d->lastModified == invalidTime)
+        d->lastModified = timeFromDateTime(d->fileInfo.lastModified());
+
+    return (d->modificationTime != invalidTime &&
+            d->lastModified != invalidTime &&
+            d->modificationTime >= d->lastModified);
+}
+
+QDateTime FileHandle::lastModified() const
+{
+    if(d->lastModified == invalidTime)
+        d->lastModified = timeFromDateTime(d->fileInfo.lastModified());
+
+    if(d->lastModified == invalidTime)
+        return QDateTime();
+
+    return QDateTime::fromMSecsSinceEpoch(d->lastModified);
 }
 
-const QDateTime &FileHandle::lastModified() const
+QDateTime FileHandle::modificationTime() const
 {
-    if(d->lastModified.isNull())
-        d->lastModified = d->fileInfo.lastModified();
+    if(d->modificationTime == invalidTime)
+        return QDateTime();
 
-    return d->lastModified;
+    return QDateTime::fromMSecsSinceEpoch(d->modificationTime);
 }
 
 void FileHandle::read(CacheDataStream &s)
 {
+    QDateTime modificationTime;
+
     switch(s.cacheVersion()) {
     case 1:
     default:
@@ -223,7 +275,9 @@ void FileHandle::read(CacheDataStream &s)
             d->tag = new Tag(d->absFilePath, true);
 
         s >> *(d->tag);
-        s >> d->modificationTime;
+        s >> modificationTime;
+
+        d->modificationTime = timeFromDateTime(modificationTime);
         break;
     }
 }
@@ -268,6 +322,11 @@ const FileHandle &FileHandle::null() // static
     return f;
 }
 
+QFuture<void> FileHandle::readTags(FileHandleList &files) // static
+{
+    return QtConcurrent::map(files, readTag);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // private methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -282,7 +341,7 @@ void FileHandle::setup(const QFileInfo &info, const QString &path)
     d = new FileHandlePrivate;
     d->fileInfo = info;
     d->absFilePath = resolveSymLinks(fileName);
-    d->modificationTime = info.lastModified();
+    d->modificationTime = timeFromDateTime(info.lastModified());
     if(!info.exists())
         kWarning() << "File" << path << "no longer exists!";
 }
@@ -30,6 +30,12 @@ class CacheDataStream;
 
 template<class T>
 class QList;
+template<class T>
+class QFuture;
+
+class FileHandle;
+
+typedef QList<FileHandle> FileHandleList;
 
 /**
  * An value based, explicitly shared wrapper around file related information
@@ -44,6 +50,11 @@ public:
     explicit FileHandle(const QFileInfo &info, const QString &path = QString());
     explicit FileHandle(const QString &path);
     FileHandle(const QString &path, CacheDataStream &s);
+    /**
+     * Creates a FileHandle for a track restored from the music cache.  The
+     * FileHandle takes ownership of \p tag.
+     */
+    FileHandle(const QString &path, Tag *tag, const QDateTime &modificationTime);
     ~FileHandle();
 
     /**
@@ -59,7 +70,13 @@ public:
 
     bool isNull() const;
     bool current() const;
-    const QDateTime &lastModified() const;
+    QDateTime lastModified() const;
+
+    /**
+     * Returns the modification time of the file as of when its tag was read,
+     * without going to the disk.
+     */
+    QDateTime modificationTime() const;
 
     void read(CacheDataStream &s);
 
@@ -72,6 +89,14 @@ public:
 
     static const FileHandle &null();
 
+    /**
+     * Starts reading the tags of all of \p files that don't have them yet, on
+     * all cores.  Parsing files with TagLib is by far the most expensive part
+     * of adding them.  \p files must not be touched until the returned future
+     * has finished.
+     */
+    static QFuture<void> readTags(FileHandleList &files);
+
 private:
     class FileHandlePrivate;
     FileHandlePrivate *d;
@@ -79,8 +104,6 @@ private:
     void setup(const QFileInfo &info, const QString &path);
 };
 
-typedef QList<FileHandle> FileHandleList;
-
 QDataStream &operator<<(QDataStream &s, const FileHandle &f);
 CacheDataStream &operator>>(CacheDataStream &s, FileHandle &f);
 
@@ -0,0 +1,93 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "foldertrie.h"
+
+// m_nodes[0] is the root, i.e. "/".
+
+FolderTrie::FolderTrie() :
+    m_nodes(1),
+    m_hasExcludedFolders(false)
+{
+}
+
+void FolderTrie::setFolders(const QStringList &folders, const QStringList &excludedFolders)
+{
+    m_nodes.clear();
+    m_nodes.append(Node());
+
+    foreach(const QString &folder, folders)
+        insert(folder, Included);
+
+    // Excluded folders win if the same folder is in both lists.
+
+    foreach(const QString &folder, excludedFolders)
+        insert(folder, Excluded);
+
+    m_hasExcludedFolders = !excludedFolders.isEmpty();
+}
+
+FolderTrie::Membership FolderTrie::membership(const QString &path) const
+{
+    int node = 0;
+    Membership result = m_nodes[0].membership;
+
+    int start = 0;
+    const int length = path.length();
+
+    while(start < length) {
+        int end = path.indexOf('/', start);
+        if(end < 0)
+            end = length;
+
+        if(end > start) {
+            const QHash<QString, int> &children = m_nodes[node].children;
+            QHash<QString, int>::ConstIterator it =
+                children.constFind(path.mid(start, end - start));
+
+            if(it == children.constEnd())
+                break;
+
+            node = it.value();
+
+            if(m_nodes[node].membership != Outside)
+                result = m_nodes[node].membership;
+        }
+
+        start = end + 1;
+    }
+
+    return result;
+}
+
+void FolderTrie::insert(const QString &path, Membership membership)
+{
+    int node = 0;
+
+    foreach(const QString &component, path.split('/', QString::SkipEmptyParts)) {
+        int child = m_nodes[node].children.value(component, -1);
+
+        if(child < 0) {
+            child = m_nodes.count();
+            m_nodes.append(Node());
+            m_nodes[node].children.insert(component, child);
+        }
+
+        node = child;
+    }
+
+    m_nodes[node].membership = membership;
+}
+
+// vim: set et sw=4 tw=0 sta:
@@ -0,0 +1,66 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_FOLDERTRIE_H
+#define JUK_FOLDERTRIE_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * Answers whether a path is in one of the music folders, in one of the
+ * excluded folders, or in neither, in time linear in the depth of the path
+ * rather than in the number of folders.
+ *
+ * The folders are stored as a tree of path components.  The innermost folder
+ * containing a path decides, so a music folder inside of an excluded folder is
+ * still included.
+ */
+class FolderTrie
+{
+public:
+    enum Membership { Outside, Included, Excluded };
+
+    FolderTrie();
+
+    /**
+     * Replaces the contents of the trie.  The paths should be canonical.
+     */
+    void setFolders(const QStringList &folders, const QStringList &excludedFolders);
+
+    Membership membership(const QString &path) const;
+
+    bool isExcluded(const QString &path) const { return membership(path) == Excluded; }
+    bool hasExcludedFolders() const { return m_hasExcludedFolders; }
+
+private:
+    struct Node
+    {
+        Node() : membership(Outside) {}
+
+        QHash<QString, int> children;
+        Membership membership;
+    };
+
+    void insert(const QString &path, Membership membership);
+
+    QVector<Node> m_nodes;
+    bool m_hasExcludedFolders;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
@@ -0,0 +1,216 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * juk-indexer scans the music folders and writes the music cache without
+ * starting JuK, e.g. from cron on a machine serving a large collection.  JuK
+ * then only has to load the cache on startup.
+ *
+ * Only the tracks below the scanned folders are replaced, the rest of the
+ * cache (e.g. tracks added from elsewhere) is kept.  It refuses to run while
+ * JuK is running, since they would each overwrite the cache written by the
+ * other; both hold a lock file next to the cache while they use it.
+ */
+
+#include <kaboutdata.h>
+#include <kcmdlineargs.h>
+#include <kcomponentdata.h>
+#include <kconfig.h>
+#include <kconfiggroup.h>
+#include <kglobal.h>
+#include <klocale.h>
+#include <kdebug.h>
+
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QFuture>
+#include <QFileInfo>
+#include <QSet>
+#include <QTextStream>
+
+#include <stdio.h>
+
+#include "cache.h"
+#include "filehandle.h"
+#include "foldertrie.h"
+#include "mediafiles.h"
+#include "pathresolver.h"
+
+static const char description[] = I18N_NOOP("Builds the JuK music cache without starting JuK");
+
+static QStringList canonicalPaths(const QStringList &paths)
+{
+    QStringList result;
+
+    foreach(const QString &path, paths) {
+        const QString canonicalPath = PathResolver::canonicalFilePath(path);
+        if(!canonicalPath.isEmpty())
+            result << canonicalPath;
+    }
+
+    return result;
+}
+
+/**
+ * Returns the media files found below \p folders, skipping the excluded
+ * folders the same way that JuK's own folder scan does.
+ */
+static FileHandleList findFiles(const QStringList &folders, const FolderTrie &folderTrie)
+{
+    FileHandleList files;
+    QSet<QString> seen; // Symlinks may lead to the same place twice.
+    QStringList directories = folders;
+
+    while(!directories.isEmpty()) {
+        QDirIterator it(directories.takeLast(), QDir::AllEntries | QDir::NoDotAndDotDot);
+
+        while(it.hasNext()) {
+            it.next();
+
+            const QFileInfo info = it.fileInfo();
+            const QString path = PathResolver::canonicalFilePath(info.absoluteFilePath());
+
+            if(path.isEmpty() || seen.contains(path))
+                continue;
+
+            seen.insert(path);
+
+            if(info.isDir()) {
+                if(!folderTrie.isExcluded(path))
+                    directories.append(path);
+            }
+            else if(info.isFile() && info.isReadable() &&
+                    MediaFiles::classify(path) == MediaFiles::MediaFile)
+            {
+                files.append(FileHandle(info, path));
+            }
+        }
+    }
+
+    return files;
+}
+
+/**
+ * Returns the tracks in the current cache, including the changes in its
+ * journal, which aren't in the folders included by \p scannedFolders.
+ */
+static FileHandleList cachedFilesOutside(const FolderTrie &scannedFolders)
+{
+    FileHandleList files;
+    FileHandle file;
+
+    while(!(file = Cache::instance()->loadNextCachedItem()).isNull()) {
+        if(scannedFolders.membership(file.absFilePath()) != FolderTrie::Included)
+            files.append(file);
+    }
+
+    return files;
+}
+
+int main(int argc, char *argv[])
+{
+    // Using JuK's name gets us JuK's configuration and data directory.
+
+    KAboutData aboutData("juk", 0, ki18n("JuK Indexer"),
+                         "3.11", ki18n(description), KAboutData::License_GPL,
+                         ki18n("© 2002–2013, Scott Wheeler, Michael Pyne, and others"));
+
+    KCmdLineArgs::init(argc, argv, &aboutData);
+
+    KCmdLineOptions options;
+    options.add("incremental", ki18n("Only read the tags of files which have changed since "
+                                     "the music cache was written"));
+    options.add("+[folder(s)]", ki18n("Folder(s) to scan instead of JuK's music folders"));
+    KCmdLineArgs::addCmdLineOptions(options);
+
+    QCoreApplication app(KCmdLineArgs::qtArgc(), KCmdLineArgs::qtArgv());
+    KComponentData componentData(&aboutData);
+
+    KCmdLineArgs *args = KCmdLineArgs::parsedArgs();
+    KConfigGroup config(KGlobal::config(), "Playlists");
+
+    QStringList folders;
+
+    if(args->count() > 0) {
+        for(int i = 0; i < args->count(); ++i)
+            folders << args->url(i).toLocalFile();
+    }
+    else
+        folders = config.readEntry("DirectoryList", QStringList());
+
+    folders = canonicalPaths(folders);
+
+    const QStringList excludedFolders =
+        canonicalPaths(config.readEntry("ExcludeDirectoryList", QStringList()));
+
+    if(folders.isEmpty()) {
+        kError() << "No music folders to scan";
+        return 1;
+    }
+
+    if(!Cache::instance()->lock()) {
+        kError() << "JuK is running, quit it before updating the music cache";
+        return 1;
+    }
+
+    const bool incremental = args->isSet("incremental");
+    args->clear();
+
+    FolderTrie folderTrie;
+    folderTrie.setFolders(folders, excludedFolders);
+
+    FileHandleList files = findFiles(folders, folderTrie);
+
+    // With the old cache mapped, FileHandle::tag() takes the tags of files
+    // which haven't changed in size or modification time since from the
+    // cache instead of the file, so it's only mapped first if that's wanted.
+
+    bool haveCache = false;
+
+    if(incremental)
+        haveCache = Cache::instance()->prepareToLoadCachedItems();
+
+    FileHandle::readTags(files).waitForFinished();
+
+    if(!incremental)
+        haveCache = Cache::instance()->prepareToLoadCachedItems();
+
+    const int scanned = files.count();
+
+    if(haveCache)
+        files += cachedFilesOutside(folderTrie);
+    else if(Cache::cacheFileExists())
+        kWarning() << "The music cache is unusable, it will only hold the scanned folders";
+
+    if(!Cache::saveCachedItems(files))
+        return 1;
+
+    // The changes in the journal have been merged into the new cache, JuK
+    // would otherwise replay them over it.
+
+    Cache::instance()->discardJournal();
+
+    QTextStream out(stdout);
+
+    out << i18np("Found 1 track in the scanned folders.",
+                 "Found %1 tracks in the scanned folders.",
+                 scanned) << endl;
+    out << i18np("Saved 1 track to the music cache.",
+                 "Saved %1 tracks to the music cache.",
+                 files.count()) << endl;
+
+    return 0;
+}
+
+// vim: set et sw=4 tw=0 sta fileencoding=utf8:
@@ -21,9 +21,14 @@
 #include <klocale.h>
 #include <kurl.h>
 #include <kio/netaccess.h>
+#include <kmimetype.h>
 
 #include <QtGui/QWidget>
 #include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QHash>
+#include <QtCore/QSet>
 
 #include <taglib.h>
 #include <taglib_config.h>
@@ -88,10 +93,137 @@ namespace MediaFiles {
     };
 
     static const char playlistExtension[] = ".m3u";
+
+    // Tags are read from several threads at once when adding files, so don't
+    // count on the mime database coping with concurrent lookups.
+    static QMutex mimeTypeMutex;
 }
 
 #define ARRAY_SIZE(arr) (sizeof(arr)/sizeof(arr[0]))
 
+typedef QHash<QString, const char *> ExtensionTable;
+
+/**
+ * Maps the lower case file extensions from the glob patterns of the types
+ * that we support to the type.  Extensions that are claimed by more than one
+ * of our types (e.g. .ogg) are left out since only the mime database can
+ * tell those apart.  The same goes for all extensions of the plain Ogg
+ * container type, since TagLib can't open those without knowing the codec
+ * inside.
+ */
+static ExtensionTable createExtensionTable()
+{
+    using namespace MediaFiles;
+
+    QList<const char *> types;
+    for(unsigned i = 0; i < ARRAY_SIZE(mediaTypes); ++i)
+        types << mediaTypes[i];
+    types << m3uType;
+
+    ExtensionTable table;
+    QSet<QString> ambiguous;
+
+    QMutexLocker locker(&mimeTypeMutex);
+
+    foreach(const char *type, types) {
+        KMimeType::Ptr mimeType = KMimeType::mimeType(QLatin1String(type));
+        if(!mimeType)
+            continue;
+
+        foreach(const QString &pattern, mimeType->patterns()) {
+            if(!pattern.startsWith(QLatin1String("*.")))
+                continue;
+
+            const QString extension = pattern.mid(2).toLower();
+
+            if(extension.isEmpty() ||
+               extension.contains(QLatin1Char('*')) ||
+               extension.contains(QLatin1Char('?')) ||
+               extension.contains(QLatin1Char('[')))
+            {
+                continue;
+            }
+
+            ExtensionTable::ConstIterator it = table.constFind(extension);
+            if(type == oggType || (it != table.constEnd() && it.value() != type))
+                ambiguous.insert(extension);
+            else
+                table.insert(extension, type);
+        }
+    }
+
+    foreach(const QString &extension, ambiguous)
+        table.remove(extension);
+
+    return table;
+}
+
+/**
+ * Returns the entry of mediaTypes (or m3uType) for fileName based only on its
+ * extension, or 0 if the mime database needs to be asked.
+ */
+static const char *typeByExtension(const QString &fileName)
+{
+    static const ExtensionTable table = createExtensionTable();
+
+    const int dot = fileName.lastIndexOf(QLatin1Char('.'));
+    if(dot < 0 || dot < fileName.lastIndexOf(QLatin1Char('/')))
+        return 0;
+
+    return table.value(fileName.mid(dot + 1).toLower(), 0);
+}
+
+static KMimeType::Ptr mimeTypeByPath(const QString &fileName)
+{
+    QMutexLocker locker(&MediaFiles::mimeTypeMutex);
+    return KMimeType::findByPath(fileName);
+}
+
+/**
+ * Returns the entry of mediaTypes that TagLib should use to open fileName, or
+ * 0 if there isn't one.
+ */
+static const char *mediaTypeByPath(const QString &fileName)
+{
+    using namespace MediaFiles;
+
+    const char *type = typeByExtension(fileName);
+    if(type)
+        return type != m3uType ? type : 0;
+
+    KMimeType::Ptr result = mimeTypeByPath(fileName);
+    if(!result->isValid())
+        return 0;
+
+    if(result->is(mp3Type))
+        return mp3Type;
+    if(result->is(flacType))
+        return flacType;
+    if(result->is(vorbisType))
+        return vorbisType;
+#ifdef TAGLIB_WITH_ASF
+    if(result->is(asfType))
+        return asfType;
+#endif
+#ifdef TAGLIB_WITH_MP4
+    if(result->is(mp4Type) || result->is(mp4AudiobookType))
+        return mp4Type;
+#endif
+    if(result->is(mpcType))
+        return mpcType;
+    if(result->is(oggflacType))
+        return oggflacType;
+#if TAGLIB_HAS_OPUSFILE
+    if(result->is(oggopusType) ||
+       (result->is(oggType) && fileName.endsWith(QLatin1String(".opus"))))
+    {
+        return oggopusType;
+    }
+#endif
+
+    return 0;
+}
+
 QStringList MediaFiles::openDialog(QWidget *parent)
 {
     KFileDialog *dialog = new KFileDialog(KUrl(), QString(), parent);
@@ -127,38 +259,34 @@ QString MediaFiles::savePlaylistDialog(const QString &playlistName, QWidget *par
 
 TagLib::File *MediaFiles::fileFactoryByType(const QString &fileName)
 {
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
-    if(!result->isValid())
+    const char *type = mediaTypeByPath(fileName);
+    if(!type)
         return 0;
 
     TagLib::File *file(0);
     QByteArray encodedFileName(QFile::encodeName(fileName));
 
-    if(result->is(mp3Type))
+    if(type == mp3Type)
         file = new TagLib::MPEG::File(encodedFileName.constData());
-    else if(result->is(flacType))
+    else if(type == flacType)
         file = new TagLib::FLAC::File(encodedFileName.constData());
-    else if(result->is(vorbisType))
+    else if(type == vorbisType)
         file = new TagLib::Vorbis::File(encodedFileName.constData());
 #ifdef TAGLIB_WITH_ASF
-    else if(result->is(asfType))
+    else if(type == asfType)
         file = new TagLib::ASF::File(encodedFileName.constData());
 #endif
 #ifdef TAGLIB_WITH_MP4
-    else if(result->is(mp4Type) || result->is(mp4AudiobookType))
+    else if(type == mp4Type || type == mp4AudiobookType)
         file = new TagLib::MP4::File(encodedFileName.constData());
 #endif
-    else if(result->is(mpcType))
+    else if(type == mpcType)
         file = new TagLib::MPC::File(encodedFileName.constData());
-    else if(result->is(oggflacType))
+    else if(type == oggflacType)
         file = new TagLib::Ogg::FLAC::File(encodedFileName.constData());
 #if TAGLIB_HAS_OPUSFILE
-    else if(result->is(oggopusType) ||
-            (result->is(oggType) && fileName.endsWith(QLatin1String(".opus")))
-            )
-    {
+    else if(type == oggopusType)
         file = new TagLib::Ogg::Opus::File(encodedFileName.constData());
-    }
 #endif
 
     return file;
@@ -166,59 +294,70 @@ TagLib::File *MediaFiles::fileFactoryByType(const QString &fileName)
 
 bool MediaFiles::isMediaFile(const QString &fileName)
 {
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
+    return classify(fileName) == MediaFile;
+}
+
+bool MediaFiles::isPlaylistFile(const QString &fileName)
+{
+    return classify(fileName) == PlaylistFile;
+}
+
+MediaFiles::FileClass MediaFiles::classify(const QString &fileName)
+{
+    const char *type = typeByExtension(fileName);
+    if(type)
+        return type == m3uType ? PlaylistFile : MediaFile;
+
+    KMimeType::Ptr result = mimeTypeByPath(fileName);
     if(!result->isValid())
-        return false;
+        return OtherFile;
+
+    if(result->is(m3uType))
+        return PlaylistFile;
 
     // Search through our table of media types for a match
     for(unsigned i = 0; i < ARRAY_SIZE(mediaTypes); ++i) {
         if(result->is(mediaTypes[i]))
-            return true;
+            return MediaFile;
     }
 
-    return false;
-}
-
-bool MediaFiles::isPlaylistFile(const QString &fileName)
-{
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
-    return result->is(m3uType);
+    return OtherFile;
 }
 
 bool MediaFiles::isMP3(const QString &fileName)
 {
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
+    KMimeType::Ptr result = mimeTypeByPath(fileName);
     return result->is(mp3Type);
 }
 
 bool MediaFiles::isOgg(const QString &fileName)
 {
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
+    KMimeType::Ptr result = mimeTypeByPath(fileName);
     return result->is(oggType);
 }
 
 bool MediaFiles::isFLAC(const QString &fileName)
 {
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
+    KMimeType::Ptr result = mimeTypeByPath(fileName);
     return result->is(flacType);
 }
 
 bool MediaFiles::isMPC(const QString &fileName)
 {
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
+    KMimeType::Ptr result = mimeTypeByPath(fileName);
     return result->is(mpcType);
 }
 
 bool MediaFiles::isVorbis(const QString &fileName)
 {
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
+    KMimeType::Ptr result = mimeTypeByPath(fileName);
     return result->is(vorbisType);
 }
 
 #ifdef TAGLIB_WITH_ASF
 bool MediaFiles::isASF(const QString &fileName)
 {
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
+    KMimeType::Ptr result = mimeTypeByPath(fileName);
     return result->is(asfType);
 }
 #endif
@@ -226,14 +365,14 @@ bool MediaFiles::isASF(const QString &fileName)
 #ifdef TAGLIB_WITH_MP4
 bool MediaFiles::isMP4(const QString &fileName)
 {
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
+    KMimeType::Ptr result = mimeTypeByPath(fileName);
     return result->is(mp4Type) || result->is(mp4AudiobookType);
 }
 #endif
 
 bool MediaFiles::isOggFLAC(const QString &fileName)
 {
-    KMimeType::Ptr result = KMimeType::findByPath(fileName);
+    KMimeType::Ptr result = mimeTypeByPath(fileName);
     return result->is(oggflacType);
 }
 
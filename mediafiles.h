@@ -34,6 +34,11 @@ namespace TagLib {
  */
 namespace MediaFiles
 {
+    /**
+     * The kinds of files that JuK knows how to handle, see classify().
+     */
+    enum FileClass { OtherFile, MediaFile, PlaylistFile };
+
     /**
      * Creates a JuK specific KFileDialog with the specified parent.
      */
@@ -62,6 +67,13 @@ namespace MediaFiles
      */
     bool isPlaylistFile(const QString &fileName);
 
+    /**
+     * Returns whether fileName is a supported media file, a supported
+     * playlist file or neither.  This is cheaper than calling both
+     * isMediaFile() and isPlaylistFile().
+     */
+    FileClass classify(const QString &fileName);
+
     /**
      * Returns a list of all supported mimetypes.
      */
@@ -0,0 +1,127 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "numberrange.h"
+
+#include <QRegExp>
+#include <QStringList>
+
+const int NumberRange::noMaximum;
+
+////////////////////////////////////////////////////////////////////////////////
+// public methods
+////////////////////////////////////////////////////////////////////////////////
+
+bool NumberRange::parse(const QString &text, int *minimum, int *maximum)
+{
+    const QString s = text.trimmed();
+    int value;
+
+    *minimum = 0;
+    *maximum = noMaximum;
+
+    if(s.startsWith(">="))
+        return parseNumber(s.mid(2), minimum);
+
+    if(s.startsWith("<="))
+        return parseNumber(s.mid(2), maximum);
+
+    if(s.startsWith('>')) {
+        if(!parseNumber(s.mid(1), &value) || value == noMaximum)
+            return false;
+
+        *minimum = value + 1;
+        return true;
+    }
+
+    if(s.startsWith('<')) {
+        if(!parseNumber(s.mid(1), &value))
+            return false;
+
+        *maximum = value - 1;
+        return true;
+    }
+
+    QRegExp between("between\\s+(.+)\\s+and\\s+(.+)", Qt::CaseInsensitive);
+
+    if(between.exactMatch(s))
+        return parseNumber(between.cap(1), minimum) && parseNumber(between.cap(2), maximum);
+
+    if(s.contains('-')) {
+        const QStringList bounds = s.split('-');
+        return bounds.count() == 2 &&
+            parseNumber(bounds[0], minimum) && parseNumber(bounds[1], maximum);
+    }
+
+    if(parseNumber(s.startsWith('=') ? s.mid(1) : s, &value)) {
+        *minimum = value;
+        *maximum = value;
+        return true;
+    }
+
+    return false;
+}
+
+QString NumberRange::format(int minimum, int maximum, bool isLength)
+{
+    if(maximum < minimum || maximum < 0)
+        return QString();
+
+    if(maximum == noMaximum)
+        return ">= " + formatNumber(minimum, isLength);
+
+    if(minimum <= 0)
+        return "<= " + formatNumber(maximum, isLength);
+
+    if(minimum == maximum)
+        return formatNumber(minimum, isLength);
+
+    return formatNumber(minimum, isLength) + " - " + formatNumber(maximum, isLength);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private methods
+////////////////////////////////////////////////////////////////////////////////
+
+bool NumberRange::parseNumber(const QString &text, int *value)
+{
+    const QStringList parts = text.split(':');
+
+    if(parts.count() > 3)
+        return false;
+
+    *value = 0;
+
+    foreach(const QString &part, parts) {
+        bool ok;
+        const int n = part.trimmed().toInt(&ok);
+
+        if(!ok || n < 0 || *value > (noMaximum - n) / 60)
+            return false;
+
+        *value = *value * 60 + n;
+    }
+
+    return true;
+}
+
+QString NumberRange::formatNumber(int value, bool isLength)
+{
+    if(isLength)
+        return QString("%1:%2").arg(value / 60).arg(value % 60, 2, 10, QChar('0'));
+
+    return QString::number(value);
+}
+
+// vim: set et sw=4 tw=0 sta:
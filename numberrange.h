@@ -0,0 +1,54 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_NUMBERRANGE_H
+#define JUK_NUMBERRANGE_H
+
+#include <QString>
+
+#include <climits>
+
+/**
+ * Converts between the text of a numeric search, such as ">= 1990", "< 192",
+ * "= 3", "3:00 - 5:00" or "between 1990 and 1999", and the inclusive range it
+ * stands for.  Ranges
+ * without an upper bound end at noMaximum.
+ */
+class NumberRange
+{
+public:
+    static const int noMaximum = INT_MAX;
+
+    /**
+     * Sets \p minimum and \p maximum to the range given by \p text.  Lengths
+     * may be given as minutes:seconds.  Returns false if \p text isn't a
+     * comparison.
+     */
+    static bool parse(const QString &text, int *minimum, int *maximum);
+
+    /**
+     * Returns the text that parse() reads back as the given range, or an empty
+     * string for a range that contains nothing.  If \p isLength is true the
+     * numbers are written as minutes:seconds.
+     */
+    static QString format(int minimum, int maximum, bool isLength = false);
+
+private:
+    static bool parseNumber(const QString &text, int *value);
+    static QString formatNumber(int value, bool isLength);
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
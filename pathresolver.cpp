@@ -0,0 +1,152 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pathresolver.h"
+
+#include <QString>
+#include <QHash>
+#include <QDir>
+#include <QFile>
+#include <QMutex>
+#include <QMutexLocker>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <limits.h>
+#include <stdlib.h>
+
+/**
+ * Maps absolute (but not necessarily canonical) directory paths to their
+ * canonical form.
+ */
+
+struct PathResolver::Data
+{
+    QMutex mutex; // Also used from the tag reading and cache threads.
+    QHash<QString, QString> directories;
+};
+
+PathResolver::Data *PathResolver::data()
+{
+    static Data data;
+    return &data;
+}
+
+static QString realPath(const QString &path)
+{
+    char real[PATH_MAX];
+
+    if(realpath(QFile::encodeName(path).constData(), real))
+        return QFile::decodeName(real);
+
+    return QString();
+}
+
+static bool isDescendant(const QString &path, const QString &directory)
+{
+    if(!path.startsWith(directory))
+        return false;
+
+    return path.length() == directory.length() ||
+        directory.endsWith('/') ||
+        path.at(directory.length()) == '/';
+}
+
+QString PathResolver::canonicalFilePath(const QString &path)
+{
+    if(path.isEmpty())
+        return QString();
+
+    QString absolutePath = QDir::isRelativePath(path)
+        ? QDir::current().absoluteFilePath(path)
+        : path;
+
+    // cleanPath() would remove ".." before any symlinks in front of it have
+    // been resolved, which can end up somewhere else than the kernel would.
+
+    if(absolutePath.endsWith("/..") || absolutePath.contains("/../"))
+        return realPath(absolutePath);
+
+    absolutePath = QDir::cleanPath(absolutePath);
+
+    const int slash = absolutePath.lastIndexOf('/');
+    if(slash <= 0)
+        return realPath(absolutePath);
+
+    const QString directory = canonicalDirectory(absolutePath.left(slash));
+    if(directory.isEmpty())
+        return QString();
+
+    // Only the last component is left to look at.  Symlinks are rare enough
+    // that they can just be left to realpath().
+
+    const QString fileName = absolutePath.mid(slash + 1);
+    const QString result = directory.endsWith('/')
+        ? directory + fileName
+        : directory + '/' + fileName;
+
+    struct stat info;
+    if(lstat(QFile::encodeName(result).constData(), &info) != 0)
+        return QString();
+
+    if(S_ISLNK(info.st_mode))
+        return realPath(result);
+
+    return result;
+}
+
+void PathResolver::invalidate(const QString &directory)
+{
+    const QString path = QDir::cleanPath(directory);
+
+    QMutexLocker locker(&data()->mutex);
+    QHash<QString, QString> &directories = data()->directories;
+
+    QHash<QString, QString>::Iterator it = directories.begin();
+    while(it != directories.end()) {
+        if(isDescendant(it.key(), path) || isDescendant(it.value(), path))
+            it = directories.erase(it);
+        else
+            ++it;
+    }
+}
+
+QString PathResolver::canonicalDirectory(const QString &directory)
+{
+    {
+        QMutexLocker locker(&data()->mutex);
+
+        QHash<QString, QString>::ConstIterator it = data()->directories.constFind(directory);
+        if(it != data()->directories.constEnd())
+            return it.value();
+    }
+
+    // Resolve without holding the lock, this may be slow on network mounts.
+
+    const QString canonical = realPath(directory);
+    if(canonical.isEmpty())
+        return QString();
+
+    QMutexLocker locker(&data()->mutex);
+    data()->directories.insert(directory, canonical);
+
+    // Canonical paths resolve to themselves, which saves a realpath() when
+    // e.g. scanning the contents of a directory found this way.
+
+    data()->directories.insert(canonical, canonical);
+
+    return canonical;
+}
+
+// vim: set et sw=4 tw=0 sta:
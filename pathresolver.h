@@ -0,0 +1,53 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_PATHRESOLVER_H
+#define JUK_PATHRESOLVER_H
+
+class QString;
+
+/**
+ * Resolves paths to their canonical form (no symlinks, "." or "..") without
+ * walking every component of every path through the kernel.  The canonical
+ * forms of directories are cached, so resolving a file in an already seen
+ * directory only needs to look at the file itself.
+ *
+ * Cached directories must be invalidated when they change, which is done from
+ * the directory watching code.  This is safe to use from any thread.
+ */
+class PathResolver
+{
+    struct Data;
+public:
+    /**
+     * Returns the canonical path of the file or directory \p path, or a null
+     * string if it doesn't exist.  Equivalent to
+     * QFileInfo::canonicalFilePath().
+     */
+    static QString canonicalFilePath(const QString &path);
+
+    /**
+     * Forgets the cached canonical paths of \p directory and everything below
+     * it.
+     */
+    static void invalidate(const QString &directory);
+
+private:
+    static Data *data();
+    static QString canonicalDirectory(const QString &directory);
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
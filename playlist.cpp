@@ -66,6 +66,7 @@
 #include "playlistcollection.h"
 #include "playlistsearch.h"
 #include "mediafiles.h"
+#include "pathresolver.h"
 #include "collectionlist.h"
 #include "filerenamer.h"
 #include "actioncollection.h"
@@ -88,6 +89,12 @@ using namespace ActionCollection;
  */
 quint32 g_trackID = 0;
 
+/**
+ * The number of searches kept by setIncrementalSearch() to go back to as
+ * characters are deleted from the query.
+ */
+static const int maxSearchStackSize = 16;
+
 /**
  * Just a shortcut of sorts.
  */
@@ -431,6 +438,12 @@ Playlist::~Playlist()
 
     clearObservers();
 
+    // The files being read belong to m_tagBatches.
+
+    m_tagReader.cancel();
+    m_tagReader.waitForFinished();
+    m_tagBatches.clear();
+
     // clearItem() will take care of removing the items from the history,
     // so call clearItems() to make sure it happens.
 
@@ -589,10 +602,17 @@ void Playlist::updateDeletedItem(PlaylistItem *item)
 {
     m_members.remove(item->file().absFilePath());
     m_search.clearItem(item);
+    m_searchStack.clear();
+    countColumnWidths(item, -1);
 
     m_history.removeAll(item);
     m_addTime.removeAll(item);
     m_subtractTime.removeAll(item);
+
+    for(QList<TagBatch>::Iterator it = m_tagBatches.begin(); it != m_tagBatches.end(); ++it) {
+        if((*it).after == item)
+            (*it).after = 0;
+    }
 }
 
 void Playlist::clearItem(PlaylistItem *item)
@@ -691,6 +711,41 @@ void Playlist::setSearch(const PlaylistSearch &s)
     TrackSequenceManager::instance()->iterator()->playlistChanged();
 }
 
+void Playlist::setIncrementalSearch(PlaylistSearch s)
+{
+    // Drop the searches that the new one doesn't narrow down, e.g. because
+    // characters were deleted from the query.
+
+    while(!m_searchStack.isEmpty() && !s.refines(m_searchStack.last()))
+        m_searchStack.removeLast();
+
+    if(m_searchStack.isEmpty())
+        s.search();
+    else if(s.components() == m_searchStack.last().components())
+        s = m_searchStack.last();
+    else
+        s.search(m_searchStack.last());
+
+    if(!s.isEmpty() &&
+       (m_searchStack.isEmpty() || !(s.components() == m_searchStack.last().components())))
+    {
+        m_searchStack.append(s);
+
+        if(m_searchStack.count() > maxSearchStackSize)
+            m_searchStack.removeFirst();
+    }
+
+    setSearch(s);
+}
+
+void Playlist::updateColumnWidth(int column, int oldWidth, int newWidth)
+{
+    if(column < m_widthSquareSums.size())
+        m_widthSquareSums[column] += qint64(newWidth) * newWidth - qint64(oldWidth) * oldWidth;
+
+    slotWeightDirty(column);
+}
+
 void Playlist::setSearchEnabled(bool enabled)
 {
     if(m_searchEnabled == enabled)
@@ -961,6 +1016,8 @@ void Playlist::slotColumnResizeModeChanged()
 
 void Playlist::dataChanged()
 {
+    m_searchStack.clear();
+
     if(m_blockDataChanged)
         return;
     PlaylistInterface::dataChanged();
@@ -1352,9 +1409,8 @@ void Playlist::addFiles(const QStringList &files, PlaylistItem *after)
     if(!after)
         after = static_cast<PlaylistItem *>(lastItem());
 
-    KApplication::setOverrideCursor(Qt::waitCursor);
-
-    m_blockDataChanged = true;
+    // Only the folders are walked here, the items are created as the tags of
+    // the files found are read, see slotTagsRead().
 
     FileHandleList queue;
 
@@ -1362,13 +1418,6 @@ void Playlist::addFiles(const QStringList &files, PlaylistItem *after)
         addFile(file, queue, true, &after);
 
     addFileHelper(queue, &after, true);
-
-    m_blockDataChanged = false;
-
-    slotWeightDirty();
-    dataChanged();
-
-    KApplication::restoreOverrideCursor();
 }
 
 void Playlist::refreshAlbums(const PlaylistItemList &items, coverKey id)
@@ -1403,27 +1452,10 @@ void Playlist::updatePlaying() const
 
 void Playlist::refreshAlbum(const QString &artist, const QString &album)
 {
-    ColumnList columns;
-    columns.append(PlaylistItem::ArtistColumn);
-    PlaylistSearch::Component artistComponent(artist, false, columns,
-                                              PlaylistSearch::Component::Exact);
-
-    columns.clear();
-    columns.append(PlaylistItem::AlbumColumn);
-    PlaylistSearch::Component albumComponent(album, false, columns,
-                                             PlaylistSearch::Component::Exact);
-
-    PlaylistSearch::ComponentList components;
-    components.append(artist);
-    components.append(album);
-
-    PlaylistList playlists;
-    playlists.append(CollectionList::instance());
-
-    PlaylistSearch search(playlists, components);
-    const PlaylistItemList matches = search.matchedItems();
+    const AlbumIndex::ItemList tracks =
+        CollectionList::instance()->albumIndex().tracks(artist, album);
 
-    foreach(PlaylistItem *item, matches)
+    foreach(CollectionListItem *item, tracks)
         item->refresh();
 }
 
@@ -1442,6 +1474,8 @@ void Playlist::hideColumn(int c, bool updateSearch)
     if(!isColumnVisible(c))
         return;
 
+    m_searchStack.clear();
+
     setColumnWidthMode(c, Manual);
     setColumnWidth(c, 0);
 
@@ -1483,6 +1517,8 @@ void Playlist::showColumn(int c, bool updateSearch)
     if(isColumnVisible(c))
         return;
 
+    m_searchStack.clear();
+
     // Just set the width to one to mark the column as visible -- we'll update
     // the real size in the next call.
 
@@ -1608,6 +1644,9 @@ void Playlist::setupItem(PlaylistItem *item)
     item->setTrackId(g_trackID);
     g_trackID++;
 
+    m_searchStack.clear();
+    countColumnWidths(item);
+
     if(!m_search.isEmpty())
         item->setVisible(m_search.checkItem(item));
 
@@ -1691,6 +1730,8 @@ void Playlist::setup()
 
     connect(m_fetcher, SIGNAL(signalCoverChanged(int)), this, SLOT(slotCoverChanged(int)));
 
+    connect(&m_tagReader, SIGNAL(finished()), this, SLOT(slotTagsRead()));
+
     // Prevent list of selected items from changing while internet search is in
     // progress.
     connect(this, SIGNAL(selectionChanged()), m_fetcher, SLOT(abortSearch()));
@@ -1816,43 +1857,62 @@ void Playlist::calculateColumnWeights()
     if(m_disableColumnWidthUpdates)
         return;
 
-    PlaylistItemList l = items();
-    QList<int>::Iterator columnIt;
-
-    QVector<double> averageWidth(columns());
-    double itemCount = l.size();
+    if(m_widthSquareSums.size() != columns())
+        recountColumnWidths();
 
-    QVector<int> cachedWidth;
+    double itemCount = childCount();
 
     // Here we're not using a real average, but averaging the squares of the
     // column widths and then using the square root of that value.  This gives
     // a nice weighting to the longer columns without doing something arbitrary
     // like adding a fixed amount of padding.
 
-    foreach(PlaylistItem *item, l) {
-        cachedWidth = item->cachedWidths();
+    if(m_columnWeights.isEmpty())
+        m_columnWeights.fill(-1, columns());
 
-        // Extra columns start at 0, but those weights aren't shared with all
-        // items.
-        for(int i = 0; i < columnOffset(); ++i) {
-            averageWidth[i] +=
-                std::pow(double(item->width(fontMetrics(), this, i)), 2.0) / itemCount;
+    foreach(int column, m_weightDirty) {
+        double averageWidth = 0;
+
+        if(column >= columnOffset()) {
+            if(itemCount > 0)
+                averageWidth = m_widthSquareSums[column] / itemCount;
         }
+        else {
 
-        for(int column = columnOffset(); column < columns(); ++column) {
-            averageWidth[column] +=
-                std::pow(double(cachedWidth[column - columnOffset()]), 2.0) / itemCount;
+            // Extra columns start at 0, but those widths aren't shared with
+            // all items, so they aren't kept track of.
+
+            for(Q3ListViewItem *item = K3ListView::firstChild(); item; item = item->nextSibling())
+                averageWidth += std::pow(double(item->width(fontMetrics(), this, column)), 2.0) / itemCount;
         }
+
+        m_columnWeights[column] = int(std::sqrt(averageWidth) + 0.5);
     }
 
-    if(m_columnWeights.isEmpty())
-        m_columnWeights.fill(-1, columns());
+    m_weightDirty.clear();
+}
 
-    foreach(int column, m_weightDirty) {
-        m_columnWeights[column] = int(std::sqrt(averageWidth[column]) + 0.5);
+void Playlist::countColumnWidths(PlaylistItem *item, int sign)
+{
+    // Until the sums are first needed they're recounted from scratch.
+
+    if(m_widthSquareSums.size() != columns())
+        return;
+
+    const QVector<int> &widths = item->d->cachedWidths;
+
+    for(int column = columnOffset(); column < columns(); ++column) {
+        const qint64 width = widths.value(column - columnOffset());
+        m_widthSquareSums[column] += sign * width * width;
     }
+}
 
-    m_weightDirty.clear();
+void Playlist::recountColumnWidths()
+{
+    m_widthSquareSums.fill(0, columns());
+
+    for(Q3ListViewItem *item = K3ListView::firstChild(); item; item = item->nextSibling())
+        countColumnWidths(static_cast<PlaylistItem *>(item));
 }
 
 void Playlist::addFile(const QString &file, FileHandleList &files, bool importPlaylists,
@@ -1879,17 +1939,18 @@ void Playlist::addFile(const QString &file, FileHandleList &files, bool importPl
     if(!fileInfo.exists())
         return;
 
-    const QString canonicalPath = fileInfo.canonicalFilePath();
+    const QString canonicalPath = PathResolver::canonicalFilePath(fileInfo.absoluteFilePath());
+    const MediaFiles::FileClass fileClass =
+        fileInfo.isDir() ? MediaFiles::OtherFile : MediaFiles::classify(file);
 
     if(fileInfo.isFile() && fileInfo.isReadable()) {
-        if(MediaFiles::isMediaFile(file)) {
-            FileHandle f(fileInfo, canonicalPath);
-            f.tag();
-            files.append(f);
-        }
+        // The tag is read later on, see addFileHelper().
+
+        if(fileClass == MediaFiles::MediaFile)
+            files.append(FileHandle(fileInfo, canonicalPath));
     }
 
-    if(importPlaylists && MediaFiles::isPlaylistFile(file) &&
+    if(importPlaylists && fileClass == MediaFiles::PlaylistFile &&
        !m_collection->containsPlaylistFile(canonicalPath))
     {
         new Playlist(m_collection, fileInfo);
@@ -1897,10 +1958,8 @@ void Playlist::addFile(const QString &file, FileHandleList &files, bool importPl
     }
 
     if(fileInfo.isDir()) {
-        foreach(const QString &directory, m_collection->excludedFolders()) {
-            if(canonicalPath.startsWith(directory))
-                return; // Exclude it
-        }
+        if(m_collection->isExcluded(canonicalPath))
+            return;
 
         QDirIterator dirIterator(canonicalPath, QDir::AllEntries | QDir::NoDotAndDotDot);
 
@@ -1928,25 +1987,28 @@ void Playlist::addFileHelper(FileHandleList &files, PlaylistItem **after, bool i
     {
         time.restart();
 
-        const bool focus = hasFocus();
-        const bool visible = isVisible() && files.count() > 20;
-
-        if(visible)
-            m_collection->raiseDistraction();
-
-        foreach(const FileHandle &fileHandle, files)
-            *after = createItem(fileHandle, *after, false);
+        TagBatch batch;
+        batch.files = files;
+        batch.after = *after;
+        batch.last = ignoreTimer;
 
+        m_tagBatches.append(batch);
         files.clear();
 
-        if(visible)
-            m_collection->lowerDistraction();
+        // The following batches go after this one's items.
+
+        *after = 0;
 
-        if(focus)
-            setFocus();
+        if(m_tagBatches.count() == 1)
+            readNextTagBatch();
     }
 }
 
+void Playlist::readNextTagBatch()
+{
+    m_tagReader.setFuture(FileHandle::readTags(m_tagBatches.first().files));
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // private slots
 ////////////////////////////////////////////////////////////////////////////////
@@ -2374,6 +2436,46 @@ void Playlist::slotPlayCurrent()
     action("forward")->trigger();
 }
 
+void Playlist::slotTagsRead()
+{
+    if(m_tagBatches.isEmpty())
+        return;
+
+    const TagBatch batch = m_tagBatches.takeFirst();
+    PlaylistItem *after = batch.after;
+
+    const bool focus = hasFocus();
+    const bool visible = isVisible() && batch.files.count() > 20;
+
+    if(visible)
+        m_collection->raiseDistraction();
+
+    m_blockDataChanged = true;
+
+    foreach(const FileHandle &fileHandle, batch.files)
+        after = createItem(fileHandle, after, false);
+
+    m_blockDataChanged = false;
+
+    if(visible)
+        m_collection->lowerDistraction();
+
+    if(focus)
+        setFocus();
+
+    if(!m_tagBatches.isEmpty()) {
+        if(!m_tagBatches.first().after)
+            m_tagBatches.first().after = after;
+
+        readNextTagBatch();
+    }
+
+    if(batch.last) {
+        slotWeightDirty();
+        dataChanged();
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // helper functions
 ////////////////////////////////////////////////////////////////////////////////
@@ -25,6 +25,7 @@
 #include <QVector>
 #include <QEvent>
 #include <QList>
+#include <QFutureWatcher>
 
 #include "covermanager.h"
 #include "stringhash.h"
@@ -272,12 +273,26 @@ public:
      */
     void setSearch(const PlaylistSearch &s);
 
+    /**
+     * Runs \a s, which hasn't been searched yet, and sets it as the search for
+     * this list.  This is meant for the search bar: while the query is being
+     * typed, only the results of the previous search are searched again.
+     */
+    void setIncrementalSearch(PlaylistSearch s);
+
     /**
      * If the search is disabled then all items will be shown, not just those that
      * match the current search.
      */
     void setSearchEnabled(bool searchEnabled);
 
+    /**
+     * Called when the width of the text of one of this list's items in
+     * \a column changes from \a oldWidth to \a newWidth, to keep the column
+     * weights up to date without going over all of the items.
+     */
+    void updateColumnWidth(int column, int oldWidth, int newWidth);
+
     /**
      * Marks \a item as either selected or deselected based.
      */
@@ -536,11 +551,24 @@ private:
      */
     void calculateColumnWeights();
 
+    /**
+     * Adds the widths of \a item to the sums used by calculateColumnWeights(),
+     * or removes them if \a sign is -1.
+     */
+    void countColumnWidths(PlaylistItem *item, int sign = 1);
+    void recountColumnWidths();
+
     void addFile(const QString &file, FileHandleList &files, bool importPlaylists,
                  PlaylistItem **after);
     void addFileHelper(FileHandleList &files, PlaylistItem **after,
                        bool ignoreTimer = false);
 
+    /**
+     * Starts reading the tags of the first batch in m_tagBatches, see
+     * slotTagsRead().
+     */
+    void readNextTagBatch();
+
     void redisplaySearch() { setSearch(m_search); }
 
     /**
@@ -652,9 +680,27 @@ private slots:
 
     void slotPlayCurrent();
 
+    /**
+     * Creates the items for the batch of files whose tags m_tagReader has just
+     * finished reading.
+     */
+    void slotTagsRead();
+
 private:
     friend class PlaylistItem;
 
+    /**
+     * Files found by addFiles() whose items are created once their tags have
+     * been read, which happens on other threads.  If \a after is 0 the items
+     * follow those of the batch before.
+     */
+    struct TagBatch
+    {
+        FileHandleList files;
+        PlaylistItem *after;
+        bool last;
+    };
+
     PlaylistCollection *m_collection;
 
     StringHash m_members;
@@ -683,9 +729,22 @@ private:
     QVector<int> m_columnFixedWidths;
     bool m_widthsDirty;
 
+    /**
+     * The sums of the squared widths of the items in each column, other than
+     * the extra columns at the start of some lists.  This is empty until the
+     * weights are first calculated.
+     */
+    QVector<qint64> m_widthSquareSums;
+
     static PlaylistItemList m_history;
     PlaylistSearch m_search;
 
+    /**
+     * The searches from the search bar leading up to the current one, each
+     * refining the one before.  This is cleared whenever the items change.
+     */
+    QList<PlaylistSearch> m_searchStack;
+
     bool m_searchEnabled;
 
     PlaylistItem *m_lastSelected;
@@ -719,6 +778,11 @@ private:
     static QVector<PlaylistItem *> m_backMenuItems;
 
     bool m_blockDataChanged;
+
+    // Only the first batch is being read at any time.
+
+    QList<TagBatch> m_tagBatches;
+    QFutureWatcher<void> m_tagReader;
 };
 
 typedef QList<Playlist *> PlaylistList;
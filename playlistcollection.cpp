@@ -51,6 +51,7 @@
 #include "upcomingplaylist.h"
 #include "directorylist.h"
 #include "mediafiles.h"
+#include "pathresolver.h"
 #include "playermanager.h"
 #include "tracksequencemanager.h"
 #include "juk.h"
@@ -104,11 +105,8 @@ PlaylistCollection::PlaylistCollection(PlayerManager *player, QStackedWidget *pl
 
     m_actionHandler = new ActionHandler(this);
 
-    // KDirLister's auto error handling seems to crash JuK during startup in
-    // readConfig().
-
-    m_dirLister.setAutoErrorHandlingEnabled(false, playlistStack);
     readConfig();
+    m_directoryWatcher.setFolderTrie(&m_folderTrie);
 }
 
 PlaylistCollection::~PlaylistCollection()
@@ -377,21 +375,39 @@ void PlaylistCollection::addFolder()
 
     if(result.status == QDialog::Accepted) {
 
-        m_dirLister.blockSignals(true);
+        m_directoryWatcher.blockSignals(true);
 
         const bool reload = m_importPlaylists != result.addPlaylists;
 
+        const QStringList excludedFolders = canonicalizeFolderPaths(result.excludedDirs);
+        const bool exclusionsChanged = excludedFolders != m_excludedFolderList;
+
         m_importPlaylists = result.addPlaylists;
-        m_excludedFolderList = canonicalizeFolderPaths(result.excludedDirs);
+        m_excludedFolderList = excludedFolders;
 
-        foreach(const QString &dir, result.addedDirs) {
-            m_dirLister.openUrl(KUrl::fromPath(dir), KDirLister::Keep);
+        foreach(const QString &dir, result.addedDirs)
             m_folderList.append(dir);
-        }
 
-        foreach(const QString &dir, result.removedDirs) {
-            m_dirLister.stop(KUrl::fromPath(dir));
+        foreach(const QString &dir, result.removedDirs)
             m_folderList.removeAll(dir);
+
+        // The watcher skips the excluded folders, so it needs the new ones
+        // before it walks anything.
+
+        updateFolderTrie();
+
+        foreach(const QString &dir, result.removedDirs)
+            m_directoryWatcher.removeFolder(dir);
+
+        if(exclusionsChanged) {
+            m_directoryWatcher.removeExcludedDirectories();
+
+            foreach(const QString &dir, m_folderList)
+                m_directoryWatcher.addFolder(dir);
+        }
+        else {
+            foreach(const QString &dir, result.addedDirs)
+                m_directoryWatcher.addFolder(dir);
         }
 
         if(reload) {
@@ -403,7 +419,7 @@ void PlaylistCollection::addFolder()
 
         saveConfig();
 
-        m_dirLister.blockSignals(false);
+        m_directoryWatcher.blockSignals(false);
     }
 }
 
@@ -511,7 +527,18 @@ void PlaylistCollection::scanFolders()
 {
     CollectionList::instance()->addFiles(m_folderList);
 
-    if(CollectionList::instance()->count() == 0)
+    // Watching is only started here since walking the folders for their
+    // subdirectories isn't something we want to do before the collection
+    // has been loaded.  After this the watched folders only change along
+    // with the folder settings, see addFolder().
+
+    foreach(const QString &folder, m_folderList)
+        m_directoryWatcher.addFolder(folder);
+
+    // The items for the folders are only created once their tags are read,
+    // so we can't wait for the collection to turn out empty.
+
+    if(m_folderList.isEmpty() && CollectionList::instance()->count() == 0)
         addFolder();
 
     enableDirWatch(true);
@@ -745,14 +772,19 @@ void PlaylistCollection::enableDirWatch(bool enable)
 {
     QObject *collection = CollectionList::instance();
 
-    m_dirLister.disconnect(object());
+    // This is toggled around every rename, so it only connects the watcher,
+    // the watched folders stay the same.
+
+    m_directoryWatcher.disconnect();
+    m_directoryWatcher.setPaused(!enable);
+
     if(enable) {
-        QObject::connect(&m_dirLister, SIGNAL(newItems(KFileItemList)),
+        QObject::connect(&m_directoryWatcher, SIGNAL(newItems(KFileItemList)),
                 object(), SLOT(slotNewItems(KFileItemList)));
-        QObject::connect(&m_dirLister, SIGNAL(refreshItems(QList<QPair<KFileItem,KFileItem> >)),
+        QObject::connect(&m_directoryWatcher, SIGNAL(refreshItems(QList<QPair<KFileItem,KFileItem> >)),
                 collection, SLOT(slotRefreshItems(QList<QPair<KFileItem,KFileItem> >)));
-        QObject::connect(&m_dirLister, SIGNAL(deleteItem(KFileItem)),
-                collection, SLOT(slotDeleteItem(KFileItem)));
+        QObject::connect(&m_directoryWatcher, SIGNAL(deleteItems(KFileItemList)),
+                collection, SLOT(slotDeleteItems(KFileItemList)));
     }
 }
 
@@ -816,14 +848,13 @@ void PlaylistCollection::removeFileFromDict(const QString &file)
 
 void PlaylistCollection::dirChanged(const QString &path)
 {
-    QString canonicalPath = QDir(path).canonicalPath();
-    if(canonicalPath.isEmpty())
-        return;
+    // Whatever changed may have been a symlink or a renamed directory.
 
-    foreach(const QString &excludedFolder, m_excludedFolderList) {
-        if(canonicalPath.startsWith(excludedFolder))
-            return;
-    }
+    PathResolver::invalidate(path);
+
+    QString canonicalPath = PathResolver::canonicalFilePath(path);
+    if(canonicalPath.isEmpty() || isExcluded(canonicalPath))
+        return;
 
     CollectionList::instance()->addFiles(QStringList(canonicalPath));
 }
@@ -842,7 +873,7 @@ Playlist *PlaylistCollection::playlistByName(const QString &name) const
 void PlaylistCollection::newItems(const KFileItemList &list) const
 {
     // Make fast-path for the normal case
-    if(m_excludedFolderList.isEmpty()) {
+    if(!m_folderTrie.hasExcludedFolders()) {
         CollectionList::instance()->slotNewItems(list);
         return;
     }
@@ -850,16 +881,13 @@ void PlaylistCollection::newItems(const KFileItemList &list) const
     // Slow case: Directories to exclude from consideration
 
     KFileItemList filteredList(list);
+    QMutableListIterator<KFileItem> filteredListIterator(filteredList);
 
-    foreach(const QString &excludedFolder, m_excludedFolderList) {
-        QMutableListIterator<KFileItem> filteredListIterator(filteredList);
+    while(filteredListIterator.hasNext()) {
+        const KFileItem fileItem = filteredListIterator.next();
 
-        while(filteredListIterator.hasNext()) {
-            const KFileItem fileItem = filteredListIterator.next();
-
-            if(fileItem.url().path().startsWith(excludedFolder))
-                filteredListIterator.remove();
-        }
+        if(isExcluded(fileItem.url().path()))
+            filteredListIterator.remove();
     }
 
     CollectionList::instance()->slotNewItems(filteredList);
@@ -878,9 +906,7 @@ void PlaylistCollection::readConfig()
     m_excludedFolderList = canonicalizeFolderPaths(
             config.readEntry("ExcludeDirectoryList", QStringList()));
 
-    foreach(const QString &folder, m_folderList) {
-        m_dirLister.openUrl(folder, KDirLister::Keep);
-    }
+    updateFolderTrie();
 }
 
 void PlaylistCollection::saveConfig()
@@ -894,6 +920,11 @@ void PlaylistCollection::saveConfig()
     config.sync();
 }
 
+void PlaylistCollection::updateFolderTrie()
+{
+    m_folderTrie.setFolders(canonicalizeFolderPaths(m_folderList), m_excludedFolderList);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // ActionHanlder implementation
 ////////////////////////////////////////////////////////////////////////////////
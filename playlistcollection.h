@@ -19,10 +19,11 @@
 
 #include "stringhash.h"
 #include "playlistinterface.h"
+#include "directorywatcher.h"
+#include "foldertrie.h"
 
 #include <kshortcut.h>
 #include <klocale.h>
-#include <kdirlister.h>
 
 #include <QPointer>
 
@@ -171,6 +172,12 @@ public:
      */
     QStringList excludedFolders() const { return m_excludedFolderList; }
 
+    /**
+     * Returns true if \p path is inside of one of the excludedFolders() and
+     * not inside of a music folder within it.  \p path should be canonical.
+     */
+    bool isExcluded(const QString &path) const { return m_folderTrie.isExcluded(path); }
+
     /**
      * This is used to put up a temporary widget over the top of the playlist
      * stack.  This is part of a trick to significantly speed up painting by
@@ -203,6 +210,7 @@ protected:
 private:
     void readConfig();
     void saveConfig();
+    void updateFolderTrie();
 
     QStackedWidget   *m_playlistStack;
     HistoryPlaylist  *m_historyPlaylist;
@@ -210,11 +218,12 @@ private:
     ActionHandler    *m_actionHandler;
     PlayerManager    *m_playerManager;
 
-    KDirLister  m_dirLister;
+    DirectoryWatcher m_directoryWatcher;
     StringHash  m_playlistNames;
     StringHash  m_playlistFiles;
     QStringList m_folderList;
     QStringList m_excludedFolderList;
+    FolderTrie  m_folderTrie;
     bool        m_importPlaylists;
     bool        m_searchEnabled;
     bool        m_playing;
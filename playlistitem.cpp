@@ -23,15 +23,41 @@
 #include <QPixmap>
 #include <QFileInfo>
 
+#include <string.h>
+
 #include "collectionlist.h"
+#include "cache.h"
 #include "musicbrainzquery.h"
 #include "tag.h"
 #include "coverinfo.h"
 #include "covermanager.h"
+#include "playlistsearch.h"
 #include "tagtransactionmanager.h"
 
 PlaylistItemList PlaylistItem::m_playingItems; // static
 
+/**
+ * Returns the field of the TrackStore shown in \a column, or -1 if the column
+ * isn't one of the text tags.
+ */
+static int textField(int column)
+{
+    switch(column) {
+    case PlaylistItem::TrackColumn:
+        return TrackStore::Title;
+    case PlaylistItem::ArtistColumn:
+        return TrackStore::Artist;
+    case PlaylistItem::AlbumColumn:
+        return TrackStore::Album;
+    case PlaylistItem::GenreColumn:
+        return TrackStore::Genre;
+    case PlaylistItem::CommentColumn:
+        return TrackStore::Comment;
+    default:
+        return -1;
+    }
+}
+
 static void startMusicBrainzQuery(const FileHandle &file)
 {
 #if HAVE_TUNEPIMP
@@ -72,6 +98,8 @@ void PlaylistItem::setFile(const FileHandle &file)
 {
     m_collectionItem->updateCollectionDict(d->fileHandle.absFilePath(), file.absFilePath());
     d->fileHandle = file;
+    d->fileNameSortKey.clear();
+    d->pathSortKey.clear();
     refresh();
 }
 
@@ -79,6 +107,8 @@ void PlaylistItem::setFile(const QString &file)
 {
     QString oldPath = d->fileHandle.absFilePath();
     d->fileHandle.setFile(file);
+    d->fileNameSortKey.clear();
+    d->pathSortKey.clear();
     m_collectionItem->updateCollectionDict(oldPath, d->fileHandle.absFilePath());
     refresh();
 }
@@ -114,6 +144,19 @@ const QPixmap *PlaylistItem::pixmap(int column) const
     return K3ListViewItem::pixmap(column);
 }
 
+QString PlaylistItem::searchKey(int column, bool ignoreAccents) const
+{
+    const Tag *tag = d->fileHandle.tag();
+    const int field = textField(column - playlist()->columnOffset());
+
+    if(tag && field >= 0) {
+        const TrackStore::StringKeys &keys = stringKeys(tag->textId(TrackStore::TextField(field)));
+        return ignoreAccents ? keys.accentlessSearchKey : keys.searchKey;
+    }
+
+    return PlaylistSearch::foldText(text(column), ignoreAccents);
+}
+
 QString PlaylistItem::text(int column) const
 {
     if(!d->fileHandle.tag())
@@ -242,6 +285,7 @@ void PlaylistItem::refreshFromDisk()
 {
     d->fileHandle.refresh();
     refresh();
+    Cache::instance()->journalUpdate(d->fileHandle);
 }
 
 void PlaylistItem::clear()
@@ -314,28 +358,18 @@ int PlaylistItem::compare(Q3ListViewItem *item, int column, bool ascending) cons
 
     // The following statments first check to see if you can sort based on the
     // specified column.  If the values for the two PlaylistItems are the same
-    // in that column it then tries to sort based on columns 1, 2, 3 and 0,
-    // (artist, album, track number, track name) in that order.
+    // in that column it then sorts by artist, album, track number and track
+    // name, in that order.  Given the cached sort keys these are all cheap.
 
-    int c = compare(this, playlistItem, column, ascending);
+    static const int tieBreakColumns[] =
+        { ArtistColumn, AlbumColumn, TrackNumberColumn, TrackColumn };
 
-    if(c != 0)
-        return c;
-    else {
-        // Loop through the columns doing comparisons until something is differnt.
-        // If all else is the same, compare the track name.
+    int c = compare(this, playlistItem, column, ascending);
 
-        int last = playlist()->isColumnVisible(AlbumColumn + offset) ? TrackNumberColumn : ArtistColumn;
+    for(int i = 0; c == 0 && i < 4; i++)
+        c = compare(this, playlistItem, tieBreakColumns[i] + offset, ascending);
 
-        for(int i = ArtistColumn; i <= last; i++) {
-            if(playlist()->isColumnVisible(i + offset)) {
-                c = compare(this, playlistItem, i, ascending);
-                if(c != 0)
-                    return c;
-            }
-        }
-        return compare(this, playlistItem, TrackColumn + offset, ascending);
-    }
+    return c;
 }
 
 int PlaylistItem::compare(const PlaylistItem *firstItem, const PlaylistItem *secondItem, int column, bool) const
@@ -376,6 +410,10 @@ int PlaylistItem::compare(const PlaylistItem *firstItem, const PlaylistItem *sec
         else
             return 0;
         break;
+    case YearColumn:
+        // Years are shown without padding and missing ones as blanks, so the
+        // numbers sort the same way as the text.
+        return firstItem->d->fileHandle.tag()->year() - secondItem->d->fileHandle.tag()->year();
     case CoverColumn:
         if(firstItem->d->fileHandle.coverInfo()->coverId() == secondItem->d->fileHandle.coverInfo()->coverId())
             return 0;
@@ -384,12 +422,86 @@ int PlaylistItem::compare(const PlaylistItem *firstItem, const PlaylistItem *sec
         else
             return 1;
         break;
+    case FileNameColumn:
+    case FullPathColumn:
+        return compareSortKeys(firstItem->fileSortKey(column - offset),
+                               secondItem->fileSortKey(column - offset));
     default:
-        return QString::localeAwareCompare(firstItem->d->metadata[column - offset],
-                                           secondItem->d->metadata[column - offset]);
+    {
+        const TrackStore::TextField field = TrackStore::TextField(textField(column - offset));
+        const TrackStore::StringId firstId = firstItem->d->fileHandle.tag()->textId(field);
+        const TrackStore::StringId secondId = secondItem->d->fileHandle.tag()->textId(field);
+
+        if(firstId == secondId)
+            return 0;
+
+        return compareSortKeys(stringKeys(firstId).sortKey, stringKeys(secondId).sortKey);
+    }
     }
 }
 
+QByteArray PlaylistItem::sortKey(const QString &text) // static
+{
+    // QString::localeAwareCompare() compares the strings in the local encoding
+    // with strcoll(), which orders them the same as strxfrm() orders its keys.
+
+    const QByteArray local = text.toLocal8Bit();
+    QByteArray key;
+    key.resize(local.size() * 2 + 1);
+
+    size_t length = strxfrm(key.data(), local.constData(), key.size());
+
+    if(length >= size_t(key.size())) {
+        key.resize(length + 1);
+        strxfrm(key.data(), local.constData(), key.size());
+    }
+
+    key.resize(length);
+    return key;
+}
+
+int PlaylistItem::compareSortKeys(const QByteArray &first, const QByteArray &second) // static
+{
+    const int c = memcmp(first.constData(), second.constData(), qMin(first.size(), second.size()));
+    return c != 0 ? c : first.size() - second.size();
+}
+
+const TrackStore::StringKeys &PlaylistItem::stringKeys(TrackStore::StringId id) // static
+{
+    TrackStore *store = TrackStore::instance();
+    const TrackStore::StringKeys *keys = store->keys(id);
+
+    if(keys)
+        return *keys;
+
+    // The keys usually come out the same as each other, in which case they
+    // share the string.
+
+    const QString text = store->string(id);
+    TrackStore::StringKeys *newKeys = new TrackStore::StringKeys;
+
+    newKeys->sortKey = sortKey(text.toLower());
+    newKeys->searchKey = PlaylistSearch::foldText(text);
+
+    const QString accentlessKey = PlaylistSearch::foldText(newKeys->searchKey, true);
+    newKeys->accentlessSearchKey = accentlessKey == newKeys->searchKey ? newKeys->searchKey : accentlessKey;
+
+    return *store->setKeys(id, newKeys);
+}
+
+const QByteArray &PlaylistItem::fileSortKey(int column) const
+{
+    // Unlike the tags, nearly every file name is different, so there's
+    // nothing to share and the keys are kept with the item instead.
+
+    QByteArray &key = column == FileNameColumn ? d->fileNameSortKey : d->pathSortKey;
+
+    if(key.isNull())
+        key = sortKey(text(column + playlist()->columnOffset()).toLower());
+
+    return key;
+}
+
 bool PlaylistItem::isValid() const
 {
     return bool(d->fileHandle.tag());
@@ -27,6 +27,7 @@
 
 #include "tagguesser.h"
 #include "filehandle.h"
+#include "trackstore.h"
 
 class Playlist;
 class PlaylistItem;
@@ -101,6 +102,13 @@ public:
     virtual QString text(int column) const;
     virtual void setText(int column, const QString &text);
 
+    /**
+     * Returns the text of \a column folded for case insensitive searches, see
+     * PlaylistSearch::foldText().  For the text tags these are kept with the
+     * strings in the TrackStore, so searching doesn't have to fold them again.
+     */
+    QString searchKey(int column, bool ignoreAccents = false) const;
+
     void setPlaying(bool playing = true, bool master = true);
 
     virtual void setSelected(bool selected);
@@ -184,6 +192,25 @@ protected:
     virtual int compare(Q3ListViewItem *item, int column, bool ascending) const;
     int compare(const PlaylistItem *firstItem, const PlaylistItem *secondItem, int column, bool ascending) const;
 
+    /**
+     * Returns the key that \a text is sorted by, which compares the same way
+     * with compareSortKeys() as \a text does with QString::localeAwareCompare().
+     */
+    static QByteArray sortKey(const QString &text);
+    static int compareSortKeys(const QByteArray &first, const QByteArray &second);
+
+    /**
+     * Returns the sort and search keys of the interned string \a id, building
+     * them the first time they're needed.
+     */
+    static const TrackStore::StringKeys &stringKeys(TrackStore::StringId id);
+
+    /**
+     * Returns the sort key of the file name or full path column, which are
+     * built the first time the item is sorted by them.
+     */
+    const QByteArray &fileSortKey(int column) const;
+
     bool isValid() const;
 
     void setTrackId(quint32 id);
@@ -199,7 +226,9 @@ protected:
         Data(const QString &path) : fileHandle(path) {}
 
         FileHandle fileHandle;
-        QVector<QString> metadata; ///< Artist, album, or genre tags.  Other columns unfilled
+        QString listedTags[3]; ///< Artist, album and genre as counted by CollectionList
+        mutable QByteArray fileNameSortKey;
+        mutable QByteArray pathSortKey;
         QVector<int> cachedWidths;
     };
 
@@ -18,10 +18,32 @@
 #include "playlist.h"
 #include "playlistitem.h"
 #include "collectionlist.h"
+#include "searchindex.h"
+#include "tag.h"
 #include "juk-exception.h"
 
 #include <kdebug.h>
 
+#include <QThread>
+#include <QtConcurrentMap>
+
+/**
+ * Playlists with fewer items than this are searched on the GUI thread alone,
+ * since handing the work out to other threads would cost more than it saves.
+ */
+static const int parallelSearchThreshold = 2000;
+
+struct PlaylistSearch::SearchChunk
+{
+    const PlaylistSearch *search;
+    const int *offsets;       // Of each component's texts within a row.
+    const QString *texts;     // A row of texts per item.
+    const bool *candidates;   // A row of flags per item, one per component.
+    int begin;
+    int end;
+    bool *matches;
+};
+
 ////////////////////////////////////////////////////////////////////////////////
 // public methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -54,15 +76,27 @@ void PlaylistSearch::search()
     // most of the time this will be searching one playlist for one search
     // component -- possibly for one column.
 
-    // Also there should be some caching of previous searches in here and
-    // allowance for appending and removing chars.  If one is added it
-    // should only search the current list.  If one is removed it should
-    // pop the previous search results off of a stack.
+    // Playlist::setIncrementalSearch() keeps a stack of the previous searches
+    // from the search bar, so that appending a character only searches the
+    // previous results, see search(const PlaylistSearch &).
+
+    // Where possible the text of the items is only compared for the items
+    // which the search index turns up.
 
     foreach(Playlist *playlist, m_playlists) {
         if(!isEmpty()) {
-            for(Q3ListViewItemIterator it(playlist); it.current(); ++it)
-                checkItem(static_cast<PlaylistItem *>(*it));
+            QVector<QSet<CollectionListItem *> > storage;
+            const CandidateList candidates = findCandidates(playlist, storage);
+
+            if(playlist->childCount() >= parallelSearchThreshold &&
+               QThread::idealThreadCount() > 1)
+            {
+                searchInParallel(playlist, candidates);
+            }
+            else {
+                for(Q3ListViewItemIterator it(playlist); it.current(); ++it)
+                    checkItem(static_cast<PlaylistItem *>(*it), candidates);
+            }
         }
         else {
             m_items += playlist->items();
@@ -73,33 +107,42 @@ void PlaylistSearch::search()
 
 bool PlaylistSearch::checkItem(PlaylistItem *item)
 {
-    m_items.append(item);
+    return checkItem(item, CandidateList());
+}
 
-    // set our default
-    bool match = bool(m_mode);
+bool PlaylistSearch::matches(PlaylistItem *item) const
+{
+    return matches(item, CandidateList());
+}
 
-    ComponentList::Iterator componentIt = m_components.begin();
-    for(; componentIt != m_components.end(); ++componentIt) {
+void PlaylistSearch::search(const PlaylistSearch &previous)
+{
+    // Nothing that failed to match the previous search can match this one.
 
-        bool componentMatches = (*componentIt).matches(item);
+    m_items = previous.m_unmatchedItems;
+    m_matchedItems.clear();
+    m_unmatchedItems = previous.m_unmatchedItems;
 
-        if(componentMatches && m_mode == MatchAny) {
-            match = true;
-            break;
-        }
+    foreach(PlaylistItem *item, previous.m_matchedItems)
+        checkItem(item);
+}
 
-        if(!componentMatches && m_mode == MatchAll) {
-            match = false;
-            break;
-        }
+bool PlaylistSearch::refines(const PlaylistSearch &previous) const
+{
+    if(isEmpty() || previous.isEmpty() ||
+       m_mode != previous.m_mode ||
+       m_playlists != previous.m_playlists ||
+       m_components.count() != previous.m_components.count())
+    {
+        return false;
     }
 
-    if(match)
-        m_matchedItems.append(item);
-    else
-        m_unmatchedItems.append(item);
+    for(int i = 0; i < m_components.count(); ++i) {
+        if(!m_components[i].refines(previous.m_components[i]))
+            return false;
+    }
 
-    return match;
+    return true;
 }
 
 void PlaylistSearch::addComponent(const Component &c)
@@ -129,8 +172,11 @@ bool PlaylistSearch::isEmpty() const
 
     ComponentList::ConstIterator it = m_components.begin();
     for(; it != m_components.end(); ++it) {
-        if(!(*it).query().isEmpty() || !(*it).pattern().isEmpty())
+        if(!(*it).query().isEmpty() || !(*it).pattern().isEmpty() ||
+           (*it).matchMode() == Component::InRange)
+        {
             return false;
+        }
     }
 
     return true;
@@ -143,6 +189,258 @@ void PlaylistSearch::clearItem(PlaylistItem *item)
     m_unmatchedItems.removeAll(item);
 }
 
+bool PlaylistSearch::updateItem(PlaylistItem *item)
+{
+    // An empty search matches everything, see search().
+
+    const bool match = isEmpty() || matches(item);
+
+    if(!m_items.contains(item)) {
+        m_items.append(item);
+
+        if(match)
+            m_matchedItems.append(item);
+        else
+            m_unmatchedItems.append(item);
+    }
+    else if(match && m_unmatchedItems.removeOne(item))
+        m_matchedItems.append(item);
+    else if(!match && m_matchedItems.removeOne(item))
+        m_unmatchedItems.append(item);
+
+    return match;
+}
+
+QString PlaylistSearch::foldText(const QString &text, bool ignoreAccents) // static
+{
+    const QString folded = text.toCaseFolded();
+
+    if(!ignoreAccents)
+        return folded;
+
+    // Decomposing splits the accents off into combining marks of their own.
+
+    const QString decomposed = folded.normalized(QString::NormalizationForm_KD);
+    QString result;
+    result.reserve(decomposed.length());
+
+    for(int i = 0; i < decomposed.length(); ++i) {
+        if(decomposed.at(i).category() != QChar::Mark_NonSpacing)
+            result.append(decomposed.at(i));
+    }
+
+    return result == folded ? folded : result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private methods
+////////////////////////////////////////////////////////////////////////////////
+
+PlaylistSearch::CandidateList PlaylistSearch::findCandidates(Playlist *playlist,
+    QVector<QSet<CollectionListItem *> > &storage) const
+{
+    CandidateList candidates(m_components.count(), 0);
+    storage.resize(m_components.count());
+    const SearchIndex &index = CollectionList::instance()->searchIndex();
+
+    for(int i = 0; i < m_components.count(); ++i) {
+
+        // The columns are those that Component::matches() will search,
+        // without the playlist's column offset.
+
+        ColumnList columns = m_components[i].columns();
+
+        if(columns.isEmpty()) {
+            for(int column = 0; column < playlist->columns(); ++column) {
+                if(playlist->isColumnVisible(column))
+                    columns.append(column);
+            }
+        }
+
+        for(ColumnList::Iterator it = columns.begin(); it != columns.end(); ++it)
+            *it -= playlist->columnOffset();
+
+        const Component &component = m_components[i];
+
+        if(component.isPatternSearch() || component.query().isEmpty())
+            continue;
+
+        // The index holds the text without accents, which is just as good for
+        // the searches that don't ignore them.
+
+        if(index.findCandidates(foldText(component.query(), true), component.matchMode(),
+                                columns, &storage[i]))
+        {
+            candidates[i] = &storage[i];
+        }
+    }
+
+    return candidates;
+}
+
+bool PlaylistSearch::checkItem(PlaylistItem *item, const CandidateList &candidates)
+{
+    m_items.append(item);
+
+    const bool match = matches(item, candidates);
+
+    if(match)
+        m_matchedItems.append(item);
+    else
+        m_unmatchedItems.append(item);
+
+    return match;
+}
+
+bool PlaylistSearch::matches(PlaylistItem *item, const CandidateList &candidates) const
+{
+    // set our default
+    bool match = bool(m_mode);
+
+    for(int i = 0; i < m_components.count(); ++i) {
+        const QSet<CollectionListItem *> *componentCandidates =
+            i < candidates.count() ? candidates[i] : 0;
+
+        bool componentMatches =
+            (!componentCandidates || !item->collectionItem() ||
+             componentCandidates->contains(item->collectionItem())) &&
+            m_components[i].matches(item);
+
+        if(componentMatches && m_mode == MatchAny) {
+            match = true;
+            break;
+        }
+
+        if(!componentMatches && m_mode == MatchAll) {
+            match = false;
+            break;
+        }
+    }
+
+    return match;
+}
+
+void PlaylistSearch::searchInParallel(Playlist *playlist, const CandidateList &candidates)
+{
+    // The items may only be read on the GUI thread, so their text is copied
+    // out first and only the matching itself is spread over the cores.
+
+    const int componentCount = m_components.count();
+
+    QVector<ColumnList> columns(componentCount);
+    QVector<int> offsets(componentCount + 1, 0);
+
+    // Numeric ranges don't need any text, and are cheap enough to check here.
+
+    for(int i = 0; i < componentCount; ++i) {
+        if(m_components[i].matchMode() != Component::InRange)
+            columns[i] = m_components[i].searchedColumns(playlist);
+        offsets[i + 1] = offsets[i] + columns[i].count();
+    }
+
+    PlaylistItemList items;
+    QVector<QString> texts;
+    QVector<bool> itemCandidates;
+
+    texts.reserve(playlist->childCount() * offsets.last());
+    itemCandidates.reserve(playlist->childCount() * componentCount);
+
+    for(Q3ListViewItemIterator it(playlist); it.current(); ++it) {
+        PlaylistItem *item = static_cast<PlaylistItem *>(*it);
+        items.append(item);
+
+        for(int i = 0; i < componentCount; ++i) {
+
+            // The text of items that the search index has already ruled out
+            // isn't needed.
+
+            const bool isCandidate =
+                m_components[i].matchMode() == Component::InRange ?
+                m_components[i].matches(item) :
+                !candidates[i] || !item->collectionItem() ||
+                candidates[i]->contains(item->collectionItem());
+
+            itemCandidates.append(isCandidate);
+
+            foreach(int column, columns[i]) {
+                texts.append(isCandidate ? m_components[i].searchedText(item, column)
+                                         : QString());
+            }
+        }
+    }
+
+    QVector<bool> matches(items.count(), false);
+
+    const int chunkCount = qMin(items.count(), QThread::idealThreadCount() * 4);
+    QVector<SearchChunk> chunks(chunkCount);
+
+    for(int i = 0; i < chunkCount; ++i) {
+        SearchChunk &chunk = chunks[i];
+
+        chunk.search = this;
+        chunk.offsets = offsets.constData();
+        chunk.texts = texts.constData();
+        chunk.candidates = itemCandidates.constData();
+        chunk.begin = qint64(items.count()) * i / chunkCount;
+        chunk.end = qint64(items.count()) * (i + 1) / chunkCount;
+        chunk.matches = matches.data();
+    }
+
+    QtConcurrent::blockingMap(chunks, searchChunk);
+
+    // Merge the results back in the playlist's order.
+
+    for(int i = 0; i < items.count(); ++i) {
+        m_items.append(items[i]);
+
+        if(matches[i])
+            m_matchedItems.append(items[i]);
+        else
+            m_unmatchedItems.append(items[i]);
+    }
+}
+
+void PlaylistSearch::searchChunk(SearchChunk &chunk) // static
+{
+    const ComponentList &components = chunk.search->m_components;
+    const int componentCount = components.count();
+    const int rowWidth = chunk.offsets[componentCount];
+
+    // QRegExp keeps the state of the last match, so each thread needs its own.
+
+    QVector<QRegExp> patterns;
+    foreach(const Component &component, components)
+        patterns.append(component.pattern());
+
+    for(int item = chunk.begin; item < chunk.end; ++item) {
+        const QString *row = chunk.texts + item * rowWidth;
+        const bool *candidates = chunk.candidates + item * componentCount;
+
+        bool match = bool(chunk.search->m_mode);
+
+        for(int i = 0; i < componentCount; ++i) {
+            bool componentMatches =
+                candidates[i] &&
+                (components[i].matchMode() == Component::InRange ||
+                 components[i].matches(row + chunk.offsets[i],
+                                       chunk.offsets[i + 1] - chunk.offsets[i],
+                                       patterns[i]));
+
+            if(componentMatches && chunk.search->m_mode == MatchAny) {
+                match = true;
+                break;
+            }
+
+            if(!componentMatches && chunk.search->m_mode == MatchAll) {
+                match = false;
+                break;
+            }
+        }
+
+        chunk.matches[item] = match;
+    }
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Component public methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -150,7 +448,10 @@ void PlaylistSearch::clearItem(PlaylistItem *item)
 PlaylistSearch::Component::Component() :
     m_mode(Contains),
     m_searchAllVisible(true),
-    m_caseSensitive(false)
+    m_caseSensitive(false),
+    m_ignoreAccents(false),
+    m_minimum(0),
+    m_maximum(0)
 {
 
 }
@@ -158,13 +459,18 @@ PlaylistSearch::Component::Component() :
 PlaylistSearch::Component::Component(const QString &query,
                                      bool caseSensitive,
                                      const ColumnList &columns,
-                                     MatchMode mode) :
+                                     MatchMode mode,
+                                     bool ignoreAccents) :
     m_query(query),
+    m_foldedQuery(foldText(query, ignoreAccents)),
     m_columns(columns),
     m_mode(mode),
     m_searchAllVisible(columns.isEmpty()),
-    m_caseSensitive(caseSensitive),
-    m_re(false)
+    m_caseSensitive(caseSensitive && !ignoreAccents),
+    m_ignoreAccents(ignoreAccents),
+    m_re(false),
+    m_minimum(0),
+    m_maximum(0)
 {
 
 }
@@ -175,80 +481,108 @@ PlaylistSearch::Component::Component(const QRegExp &query, const ColumnList& col
     m_mode(Exact),
     m_searchAllVisible(columns.isEmpty()),
     m_caseSensitive(false),
-    m_re(true)
+    m_ignoreAccents(false),
+    m_re(true),
+    m_minimum(0),
+    m_maximum(0)
 {
 
 }
 
-bool PlaylistSearch::Component::matches(PlaylistItem *item) const
+PlaylistSearch::Component::Component(int column, int minimum, int maximum) :
+    m_columns(ColumnList() << column),
+    m_mode(InRange),
+    m_searchAllVisible(false),
+    m_caseSensitive(false),
+    m_ignoreAccents(false),
+    m_re(false),
+    m_minimum(minimum),
+    m_maximum(maximum)
 {
-    if((m_re && m_queryRe.isEmpty()) || (!m_re && m_query.isEmpty()))
-        return false;
 
-    if(m_columns.isEmpty()) {
-        Playlist *p = static_cast<Playlist *>(item->listView());
-        for(int i = 0; i < p->columns(); i++) {
-            if(p->isColumnVisible(i))
-                m_columns.append(i);
-        }
+}
+
+bool PlaylistSearch::Component::refines(const Component &previous) const
+{
+    // An empty query matches nothing, so there's nothing to narrow down.
+
+    if(m_re || previous.m_re || m_mode != Contains || previous.m_mode != Contains ||
+       previous.m_query.isEmpty() || m_caseSensitive != previous.m_caseSensitive ||
+       m_ignoreAccents != previous.m_ignoreAccents)
+    {
+        return false;
     }
 
+    // The columns of a search of all visible columns are only filled in once
+    // it has been run, so they can't be compared.
 
-    for(ColumnList::Iterator it = m_columns.begin(); it != m_columns.end(); ++it) {
+    if(m_searchAllVisible != previous.m_searchAllVisible ||
+       (!m_searchAllVisible && m_columns != previous.m_columns))
+    {
+        return false;
+    }
 
-        if(m_re) {
-            if(item->text(*it).contains(m_queryRe))
-                return true;
-            else
-                break;
-        }
+    if(m_caseSensitive)
+        return m_query.contains(previous.m_query);
 
-        switch(m_mode) {
-        case Contains:
-            if(item->text(*it).contains(m_query, m_caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive))
-                return true;
-            break;
-        case Exact:
-            if(item->text(*it).length() == m_query.length()) {
-                if(m_caseSensitive) {
-                    if(item->text(*it) == m_query)
-                        return true;
-                }
-                else if(item->text(*it).toLower() == m_query.toLower())
-                    return true;
-            }
-            break;
-        case ContainsWord:
-        {
-            QString s = item->text(*it);
-            int i = s.indexOf(m_query, 0, m_caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive );
+    return m_foldedQuery.contains(previous.m_foldedQuery);
+}
 
-            if(i >= 0) {
+bool PlaylistSearch::Component::matches(PlaylistItem *item) const
+{
+    if(m_mode == InRange)
+        return matchesRange(item);
 
-                // If we found the pattern and the lengths are the same, then
-                // this is a match.
+    if((m_re && m_queryRe.isEmpty()) || (!m_re && m_query.isEmpty()))
+        return false;
 
-                if(s.length() == m_query.length())
-                    return true;
+    const ColumnList columns = searchedColumns(static_cast<Playlist *>(item->listView()));
 
-                // First: If the match starts at the beginning of the text or the
-                // character before the match is not a word character
+    for(ColumnList::ConstIterator it = columns.begin(); it != columns.end(); ++it) {
 
-                // AND
+        // Patterns are only matched against the first column.
 
-                // Second: Either the pattern was found at the end of the text,
-                // or the text following the match is a non-word character
+        if(m_re)
+            return item->text(*it).contains(m_queryRe);
 
-                // ...then we have a match
+        if(matchesText(searchedText(item, *it)))
+            return true;
+    }
+    return false;
+}
 
-                if((i == 0 || !s.at(i - 1).isLetterOrNumber()) &&
-                   (i + m_query.length() == s.length() || !s.at(i + m_query.length()).isLetterOrNumber()))
-                    return true;
-                break;
-            }
-        }
+ColumnList PlaylistSearch::Component::searchedColumns(Playlist *playlist) const
+{
+    if(m_columns.isEmpty()) {
+        for(int i = 0; i < playlist->columns(); i++) {
+            if(playlist->isColumnVisible(i))
+                m_columns.append(i);
         }
     }
+
+    return m_columns;
+}
+
+QString PlaylistSearch::Component::searchedText(PlaylistItem *item, int column) const
+{
+    if(m_re || m_caseSensitive)
+        return item->text(column);
+
+    return item->searchKey(column, m_ignoreAccents);
+}
+
+bool PlaylistSearch::Component::matches(const QString *texts, int count, QRegExp &pattern) const
+{
+    if((m_re && m_queryRe.isEmpty()) || (!m_re && m_query.isEmpty()))
+        return false;
+
+    if(m_re)
+        return count > 0 && texts[0].contains(pattern);
+
+    for(int i = 0; i < count; ++i) {
+        if(matchesText(texts[i]))
+            return true;
+    }
     return false;
 }
 
@@ -260,13 +594,102 @@ bool PlaylistSearch::Component::operator==(const Component &v) const
         m_mode == v.m_mode &&
         m_searchAllVisible == v.m_searchAllVisible &&
         m_caseSensitive == v.m_caseSensitive &&
-        m_re == v.m_re;
+        m_ignoreAccents == v.m_ignoreAccents &&
+        m_re == v.m_re &&
+        m_minimum == v.m_minimum &&
+        m_maximum == v.m_maximum;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Component private methods
+////////////////////////////////////////////////////////////////////////////////
+
+bool PlaylistSearch::Component::matchesText(const QString &s) const
+{
+    // Unless the search is case sensitive s is already folded, see
+    // searchedText(), so this only has to compare it to the folded query.
+
+    const QString &query = m_caseSensitive ? m_query : m_foldedQuery;
+
+    switch(m_mode) {
+    case Contains:
+        return s.contains(query);
+    case Exact:
+        return s == query;
+    case InRange:
+        break;
+    case ContainsWord:
+    {
+        int i = s.indexOf(query);
+
+        if(i < 0)
+            return false;
+
+        // If we found the pattern and the lengths are the same, then
+        // this is a match.
+
+        if(s.length() == query.length())
+            return true;
+
+        // First: If the match starts at the beginning of the text or the
+        // character before the match is not a word character
+
+        // AND
+
+        // Second: Either the pattern was found at the end of the text,
+        // or the text following the match is a non-word character
+
+        // ...then we have a match
+
+        return (i == 0 || !s.at(i - 1).isLetterOrNumber()) &&
+               (i + query.length() == s.length() || !s.at(i + query.length()).isLetterOrNumber());
+    }
+    }
+
+    return false;
+}
+
+bool PlaylistSearch::Component::matchesRange(PlaylistItem *item) const
+{
+    const Tag *tag = item->file().tag();
+
+    if(!tag || m_columns.isEmpty())
+        return false;
+
+    // This reads the numbers straight from the tag, rather than parsing them
+    // back out of the formatted text.
+
+    int value;
+
+    switch(m_columns.first() - static_cast<Playlist *>(item->listView())->columnOffset()) {
+    case PlaylistItem::TrackNumberColumn:
+        value = tag->track();
+        break;
+    case PlaylistItem::YearColumn:
+        value = tag->year();
+        break;
+    case PlaylistItem::LengthColumn:
+        value = tag->seconds();
+        break;
+    case PlaylistItem::BitrateColumn:
+        value = tag->bitrate();
+        break;
+    default:
+        return false;
+    }
+
+    return value > 0 && value >= m_minimum && value <= m_maximum;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 // helper functions
 ////////////////////////////////////////////////////////////////////////////////
 
+// Stored along with the match mode, which keeps the stream format unchanged
+// for all other searches.
+
+static const qint32 ignoreAccentsFlag = 0x100;
+
 QDataStream &operator<<(QDataStream &s, const PlaylistSearch &search)
 {
     s << search.components()
@@ -300,7 +723,10 @@ QDataStream &operator<<(QDataStream &s, const PlaylistSearch::Component &c)
       << (c.isPatternSearch() ? c.pattern().pattern() : c.query())
       << c.isCaseSensitive()
       << c.columns()
-      << qint32(c.matchMode());
+      << (qint32(c.matchMode()) | (c.ignoresAccents() ? ignoreAccentsFlag : 0));
+
+    if(c.matchMode() == PlaylistSearch::Component::InRange)
+        s << qint32(c.minimum()) << qint32(c.maximum());
 
     return s;
 }
@@ -319,10 +745,21 @@ QDataStream &operator>>(QDataStream &s, PlaylistSearch::Component &c)
       >> columns
       >> mode;
 
-    if(patternSearch)
+    if(mode == PlaylistSearch::Component::InRange) {
+        qint32 minimum;
+        qint32 maximum;
+
+        s >> minimum
+          >> maximum;
+
+        c = PlaylistSearch::Component(columns.value(0, -1), minimum, maximum);
+    }
+    else if(patternSearch)
         c = PlaylistSearch::Component(QRegExp(pattern), columns);
     else
-        c = PlaylistSearch::Component(pattern, caseSensitive, columns, PlaylistSearch::Component::MatchMode(mode));
+        c = PlaylistSearch::Component(pattern, caseSensitive, columns,
+                                      PlaylistSearch::Component::MatchMode(mode & ~ignoreAccentsFlag),
+                                      (mode & ignoreAccentsFlag) != 0);
 
     return s;
 }
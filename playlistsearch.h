@@ -19,9 +19,12 @@
 
 #include <QRegExp>
 #include <QList>
+#include <QSet>
+#include <QVector>
 
 class Playlist;
 class PlaylistItem;
+class CollectionListItem;
 
 typedef QList<int> ColumnList;
 typedef QList<PlaylistItem *> PlaylistItemList;
@@ -44,6 +47,24 @@ public:
     void search();
     bool checkItem(PlaylistItem *item);
 
+    /**
+     * Returns true if \a item matches this search.  Unlike checkItem() this
+     * doesn't add it to the searched items.
+     */
+    bool matches(PlaylistItem *item) const;
+
+    /**
+     * Searches only the items matched by \a previous, which gives the same
+     * results as search() if this search refines() it.
+     */
+    void search(const PlaylistSearch &previous);
+
+    /**
+     * Returns true if every item matching this search also matches \a previous,
+     * as happens when characters are appended to the query.
+     */
+    bool refines(const PlaylistSearch &previous) const;
+
     PlaylistItemList searchedItems() const { return m_items; }
     PlaylistItemList matchedItems() const { return m_matchedItems; }
     PlaylistItemList unmatchedItems() const { return m_unmatchedItems; }
@@ -69,7 +90,40 @@ public:
      */
     void clearItem(PlaylistItem *item);
 
+    /**
+     * Checks \a item again after it has changed, moving it between the matched
+     * and unmatched lists (or adding it to them if it is new) without having
+     * to search again.  Returns true if it matches.
+     */
+    bool updateItem(PlaylistItem *item);
+
+    /**
+     * Returns \a text as case insensitive searches compare it: case folded,
+     * and also without accents if \a ignoreAccents is true.
+     */
+    static QString foldText(const QString &text, bool ignoreAccents = false);
+
 private:
+    /**
+     * For each component, the items in the collection which may match it as
+     * found in the CollectionList's SearchIndex, or null if every item has to
+     * be checked.
+     */
+    typedef QVector<const QSet<CollectionListItem *> *> CandidateList;
+
+    CandidateList findCandidates(Playlist *playlist,
+                                 QVector<QSet<CollectionListItem *> > &storage) const;
+    bool checkItem(PlaylistItem *item, const CandidateList &candidates);
+    bool matches(PlaylistItem *item, const CandidateList &candidates) const;
+
+    /**
+     * A range of the items of a playlist to be matched on a worker thread.
+     */
+    struct SearchChunk;
+
+    void searchInParallel(Playlist *playlist, const CandidateList &candidates);
+    static void searchChunk(SearchChunk &chunk);
+
     PlaylistList m_playlists;
     ComponentList m_components;
     SearchMode m_mode;
@@ -87,7 +141,7 @@ private:
 class PlaylistSearch::Component
 {
 public:
-    enum MatchMode { Contains = 0, Exact = 1, ContainsWord = 2 };
+    enum MatchMode { Contains = 0, Exact = 1, ContainsWord = 2, InRange = 3 };
 
     /**
      * Create an empty search component.  This is only provided for use by
@@ -97,36 +151,84 @@ public:
 
     /**
      * Create a query component.  This defaults to searching all visible coulumns.
+     * If \a ignoreAccents is true then the search is case insensitive and
+     * also ignores accents, so that e.g. "cafe" matches "Café".
      */
     Component(const QString &query,
               bool caseSensitive = false,
               const ColumnList &columns = ColumnList(),
-              MatchMode mode = Contains);
+              MatchMode mode = Contains,
+              bool ignoreAccents = false);
 
     /**
      * Create a query component.  This defaults to searching all visible coulumns.
      */
     Component(const QRegExp &query, const ColumnList &columns = ColumnList());
 
+    /**
+     * Create a component that matches the items whose value in \a column is
+     * between \a minimum and \a maximum, inclusive.  This only works for the
+     * year, track number, length (in seconds) and bitrate columns, which are
+     * compared as numbers.  Items without a value never match.
+     */
+    Component(int column, int minimum, int maximum);
+
     QString query() const { return m_query; }
     QRegExp pattern() const { return m_queryRe; }
     ColumnList columns() const { return m_columns; }
 
     bool matches(PlaylistItem *item) const;
+
+    /**
+     * Returns the columns that matches() searches in the items of \a playlist.
+     */
+    ColumnList searchedColumns(Playlist *playlist) const;
+
+    /**
+     * Returns the text of \a column in \a item the way matches() compares it,
+     * which is its search key unless the search is case sensitive.
+     */
+    QString searchedText(PlaylistItem *item, int column) const;
+
+    /**
+     * Works like matches(), but on the \a count strings in \a texts, which are
+     * an item's text in each of the searchedColumns().  Since \a pattern is
+     * used in place of pattern() this may be called from several threads, each
+     * with its own copy.
+     */
+    bool matches(const QString *texts, int count, QRegExp &pattern) const;
+
     bool isPatternSearch() const { return m_re; }
     bool isCaseSensitive() const { return m_caseSensitive; }
+    bool ignoresAccents() const { return m_ignoreAccents; }
     MatchMode matchMode() const { return m_mode; }
+    int minimum() const { return m_minimum; }
+    int maximum() const { return m_maximum; }
+
+    /**
+     * Returns true if every item matching this component also matches
+     * \a previous.  This only holds for plain substring searches over the same
+     * columns where the query contains the previous one.
+     */
+    bool refines(const Component &previous) const;
 
     bool operator==(const Component &v) const;
 
 private:
+    bool matchesText(const QString &text) const;
+    bool matchesRange(PlaylistItem *item) const;
+
     QString m_query;
+    QString m_foldedQuery;
     QRegExp m_queryRe;
     mutable ColumnList m_columns;
     MatchMode m_mode;
     bool m_searchAllVisible;
     bool m_caseSensitive;
+    bool m_ignoreAccents;
     bool m_re;
+    int m_minimum;
+    int m_maximum;
 };
 
 /**
@@ -300,8 +300,8 @@ void PlaylistSplitter::slotShowSearchResults()
 {
     PlaylistList playlists;
     playlists.append(visiblePlaylist());
-    PlaylistSearch search = m_searchWidget->search(playlists);
-    visiblePlaylist()->setSearch(search);
+    PlaylistSearch search = m_searchWidget->search(playlists, false);
+    visiblePlaylist()->setIncrementalSearch(search);
 }
 
 void PlaylistSplitter::slotPlaylistSelectionChanged()
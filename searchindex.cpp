@@ -0,0 +1,285 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "searchindex.h"
+
+#include <QList>
+
+#include <algorithm>
+#include <iterator>
+
+#include "playlistitem.h"
+
+// A posting packs the item id above the column.
+
+static const int columnBits = 4;
+static const quint32 columnMask = (1 << columnBits) - 1;
+static const quint32 maximumId = (1 << (32 - columnBits)) - 1;
+
+// Marks the ids of removed items while compacting.
+
+static const quint32 noId = quint32(-1);
+
+// Stale postings are only worth the time to clean out once there are this
+// many of them, and they outnumber the live items.
+
+static const int minimumRemovedForCompaction = 1024;
+
+static bool postingsSizeLessThan(const QVector<quint32> *a, const QVector<quint32> *b)
+{
+    return a->size() < b->size();
+}
+
+SearchIndex::SearchIndex() :
+    m_removed(0)
+{
+}
+
+void SearchIndex::insert(CollectionListItem *item, const QStringList &keys)
+{
+    remove(item);
+
+    if(quint32(m_items.size()) > maximumId)
+        compact();
+
+    const quint32 id = m_items.size();
+
+    m_items.append(item);
+    m_ids.insert(item, id);
+
+    index(id, keys);
+}
+
+void SearchIndex::remove(CollectionListItem *item)
+{
+    QHash<CollectionListItem *, quint32>::Iterator it = m_ids.find(item);
+    if(it == m_ids.end())
+        return;
+
+    m_items[it.value()] = 0;
+    m_ids.erase(it);
+
+    if(++m_removed > minimumRemovedForCompaction && m_removed > m_ids.count())
+        compact();
+}
+
+void SearchIndex::clear()
+{
+    m_items.clear();
+    m_ids.clear();
+    m_words.clear();
+    m_trigrams.clear();
+    m_removed = 0;
+}
+
+bool SearchIndex::findCandidates(const QString &query,
+                                 PlaylistSearch::Component::MatchMode mode,
+                                 const ColumnList &columns, ItemSet *items) const
+{
+    if(mode == PlaylistSearch::Component::InRange || query.isEmpty() || columns.isEmpty())
+        return false;
+
+    quint32 columnsWanted = 0;
+
+    foreach(int column, columns) {
+        if(!isIndexed(column))
+            return false;
+        columnsWanted |= 1 << column;
+    }
+
+    QList<const Postings *> postings;
+
+    items->clear();
+
+    if(mode == PlaylistSearch::Component::Contains) {
+
+        // Shorter queries match too much of the collection for the index to
+        // be of much use anyways.
+
+        if(query.length() < 3)
+            return false;
+
+        foreach(quint64 trigram, trigrams(query)) {
+            QHash<quint64, Postings>::ConstIterator it = m_trigrams.constFind(trigram);
+            if(it == m_trigrams.constEnd())
+                return true;
+            postings.append(&it.value());
+        }
+    }
+    else {
+        const QSet<QString> queryWords = words(query);
+        if(queryWords.isEmpty())
+            return false;
+
+        foreach(const QString &word, queryWords) {
+            QHash<QString, Postings>::ConstIterator it = m_words.constFind(word);
+            if(it == m_words.constEnd())
+                return true;
+            postings.append(&it.value());
+        }
+    }
+
+    // Start with the shortest list and narrow it down by the others.
+
+    std::sort(postings.begin(), postings.end(), postingsSizeLessThan);
+
+    Postings result;
+    result.reserve(postings.first()->size());
+
+    foreach(quint32 posting, *postings.first()) {
+        if(columnsWanted & (1 << (posting & columnMask)))
+            result.append(posting);
+    }
+
+    for(int i = 1; i < postings.count() && !result.isEmpty(); ++i) {
+        Postings intersection;
+        intersection.reserve(result.size());
+
+        std::set_intersection(result.constBegin(), result.constEnd(),
+                              postings[i]->constBegin(), postings[i]->constEnd(),
+                              std::back_inserter(intersection));
+        result = intersection;
+    }
+
+    foreach(quint32 posting, result) {
+        CollectionListItem *item = m_items[posting >> columnBits];
+        if(item)
+            items->insert(item);
+    }
+
+    return true;
+}
+
+bool SearchIndex::isIndexed(int column)
+{
+    // Comments, file names and paths are hidden by default and would make up
+    // most of the index.
+
+    return column >= 0 &&
+        column < PlaylistItem::FileNameColumn &&
+        column != PlaylistItem::CommentColumn;
+}
+
+QSet<QString> SearchIndex::words(const QString &foldedText)
+{
+    QSet<QString> result;
+
+    const int length = foldedText.length();
+    int start = -1;
+
+    for(int i = 0; i <= length; ++i) {
+        const bool isWordCharacter = i < length && foldedText.at(i).isLetterOrNumber();
+
+        if(isWordCharacter && start < 0)
+            start = i;
+        else if(!isWordCharacter && start >= 0) {
+            result.insert(foldedText.mid(start, i - start));
+            start = -1;
+        }
+    }
+
+    return result;
+}
+
+QSet<quint64> SearchIndex::trigrams(const QString &foldedText)
+{
+    QSet<quint64> result;
+
+    const ushort *data = foldedText.utf16();
+
+    for(int i = 0; i + 2 < foldedText.length(); ++i) {
+        result.insert((quint64(data[i]) << 32) |
+                      (quint64(data[i + 1]) << 16) |
+                      quint64(data[i + 2]));
+    }
+
+    return result;
+}
+
+void SearchIndex::index(quint32 id, const QStringList &keys)
+{
+    // Columns are visited in order so that each key's postings stay sorted.
+
+    for(int column = 0; column < keys.count(); ++column) {
+        if(!isIndexed(column))
+            continue;
+
+        const QString &text = keys[column];
+        if(text.isEmpty())
+            continue;
+
+        const quint32 posting = (id << columnBits) | quint32(column);
+
+        foreach(const QString &word, words(text))
+            m_words[word].append(posting);
+
+        foreach(quint64 trigram, trigrams(text))
+            m_trigrams[trigram].append(posting);
+    }
+}
+
+template <class Key>
+void SearchIndex::compactPostings(QHash<Key, Postings> &postings, const QVector<quint32> &newIds)
+{
+    typename QHash<Key, Postings>::Iterator it = postings.begin();
+
+    while(it != postings.end()) {
+        Postings &list = it.value();
+        int size = 0;
+
+        for(int i = 0; i < list.size(); ++i) {
+            const quint32 id = newIds[list[i] >> columnBits];
+            if(id != noId)
+                list[size++] = (id << columnBits) | (list[i] & columnMask);
+        }
+
+        if(size == 0)
+            it = postings.erase(it);
+        else {
+            list.resize(size);
+            list.squeeze();
+            ++it;
+        }
+    }
+
+    postings.squeeze();
+}
+
+void SearchIndex::compact()
+{
+    // The live items keep their order when they're numbered again, so the
+    // postings stay sorted without having to index anything again.
+
+    QVector<quint32> newIds(m_items.size(), noId);
+    QVector<CollectionListItem *> items;
+    items.reserve(m_ids.count());
+
+    for(int id = 0; id < m_items.size(); ++id) {
+        CollectionListItem *item = m_items[id];
+        if(!item)
+            continue;
+
+        newIds[id] = items.size();
+        m_ids[item] = items.size();
+        items.append(item);
+    }
+
+    m_items = items;
+    m_removed = 0;
+
+    compactPostings(m_words, newIds);
+    compactPostings(m_trigrams, newIds);
+}
+
+// vim: set et sw=4 tw=0 sta:
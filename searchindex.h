@@ -0,0 +1,96 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_SEARCHINDEX_H
+#define JUK_SEARCHINDEX_H
+
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QString>
+#include <QStringList>
+
+#include "playlistsearch.h"
+
+class CollectionListItem;
+
+/**
+ * An inverted index over the text of the CollectionListItems, used to narrow
+ * down the items a search component has to be checked against.  Words are
+ * indexed for the Exact and ContainsWord match modes, and trigrams for
+ * Contains.  Everything is case folded and stripped of accents, so the index
+ * can only ever return too many items, never too few; the candidates still
+ * need to be checked with PlaylistSearch::Component::matches().
+ *
+ * Each posting is an item id and the column the key was found in.  Ids are
+ * handed out in increasing order, so the postings stay sorted just by
+ * appending to them.  Removed items leave stale postings behind, which are
+ * skipped when searching and dropped once they make up most of the index.
+ */
+class SearchIndex
+{
+public:
+    typedef QSet<CollectionListItem *> ItemSet;
+
+    SearchIndex();
+
+    /**
+     * Adds \p item to the index, replacing what was indexed for it before.
+     * \p keys holds the item's text for each column, as given by
+     * PlaylistSearch::foldText() with accents ignored.  Only the columns for
+     * which isIndexed() is true are looked at.
+     */
+    void insert(CollectionListItem *item, const QStringList &keys);
+    void remove(CollectionListItem *item);
+    void clear();
+
+    /**
+     * Sets \p items to the items which may match a search for \p foldedQuery
+     * with the given match mode in the given columns.  The query has to be
+     * folded like the keys given to insert(), and the columns are
+     * PlaylistItem::ColumnTypes, i.e. without any playlist's column offset.
+     * Returns false if the index can't help with this search, in which case
+     * every item needs to be checked.
+     */
+    bool findCandidates(const QString &foldedQuery,
+                        PlaylistSearch::Component::MatchMode mode,
+                        const ColumnList &columns, ItemSet *items) const;
+
+    /**
+     * Returns true if the text of \p column goes into the index.
+     */
+    static bool isIndexed(int column);
+
+private:
+    typedef QVector<quint32> Postings;
+
+    static QSet<QString> words(const QString &foldedText);
+    static QSet<quint64> trigrams(const QString &foldedText);
+
+    template <class Key>
+    static void compactPostings(QHash<Key, Postings> &postings, const QVector<quint32> &newIds);
+
+    void index(quint32 id, const QStringList &keys);
+    void compact();
+
+    QVector<CollectionListItem *> m_items;
+    QHash<CollectionListItem *, quint32> m_ids;
+    QHash<QString, Postings> m_words;
+    QHash<quint64, Postings> m_trigrams;
+    int m_removed;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
@@ -37,7 +37,8 @@ SearchPlaylist::SearchPlaylist(PlaylistCollection *collection,
                     setupPlaylist, synchronizePlaying),
     m_search(search)
 {
-
+    connect(CollectionList::instance(), SIGNAL(signalItemRefreshed(CollectionListItem*)),
+            this, SLOT(slotItemRefreshed(CollectionListItem*)));
 }
 
 void SearchPlaylist::setPlaylistSearch(const PlaylistSearch &s, bool update)
@@ -47,6 +48,16 @@ void SearchPlaylist::setPlaylistSearch(const PlaylistSearch &s, bool update)
         setPlaylists(s.playlists());
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// public slots
+////////////////////////////////////////////////////////////////////////////////
+
+void SearchPlaylist::slotSetDirty()
+{
+    if(!searchesCollectionList())
+        DynamicPlaylist::slotSetDirty();
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // protected methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -82,6 +93,41 @@ void SearchPlaylist::updateItems()
     }
 }
 
+////////////////////////////////////////////////////////////////////////////////
+// private slots
+////////////////////////////////////////////////////////////////////////////////
+
+void SearchPlaylist::slotItemRefreshed(CollectionListItem *item)
+{
+    // Until the items have been searched for the first time there's nothing
+    // to keep up to date.  Tracks that are removed take their items in every
+    // playlist with them, so only new and changed tracks need a look.
+
+    if(dirty() || !searchesCollectionList())
+        return;
+
+    // This keeps the search's own lists of matched items in step with the
+    // items shown here as well.
+
+    const bool matches = m_search.updateItem(item);
+    PlaylistItem *existing = item->itemForPlaylist(this);
+
+    if(matches && !existing)
+        createItems(PlaylistItemList() << item);
+    else if(!matches && existing)
+        clearItem(existing);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private methods
+////////////////////////////////////////////////////////////////////////////////
+
+bool SearchPlaylist::searchesCollectionList() const
+{
+    return m_search.playlists().count() == 1 &&
+        m_search.playlists().first() == CollectionList::instance();
+}
+
 
 ////////////////////////////////////////////////////////////////////////////////
 // helper functions
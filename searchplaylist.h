@@ -33,13 +33,25 @@ public:
     void setPlaylistSearch(const PlaylistSearch &s, bool update = true);
     virtual bool searchIsEditable() const { return true; }
 
+public slots:
+    /**
+     * Reimplemented to ignore changes to the collection list, which are
+     * picked up track by track instead, unless other playlists are searched.
+     */
+    virtual void slotSetDirty();
+
 protected:
     /**
      * Runs the search to update the current items.
      */
     virtual void updateItems();
 
+private slots:
+    void slotItemRefreshed(CollectionListItem *item);
+
 private:
+    bool searchesCollectionList() const;
+
     PlaylistSearch m_search;
 };
 
@@ -19,6 +19,7 @@
 #include "collectionlist.h"
 #include "actioncollection.h"
 #include "searchadaptor.h"
+#include "numberrange.h"
 
 #include <klocale.h>
 #include <klineedit.h>
@@ -36,6 +37,17 @@
 
 using namespace ActionCollection;
 
+/**
+ * Returns the text of a number range search, with lengths as minutes:seconds.
+ */
+static QString formatRange(const PlaylistSearch::Component &component)
+{
+    const int column = component.columns().value(0, -1) - CollectionList::instance()->columnOffset();
+
+    return NumberRange::format(component.minimum(), component.maximum(),
+                               column == PlaylistItem::LengthColumn);
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // SearchLine public methods
 ////////////////////////////////////////////////////////////////////////////////
@@ -43,7 +55,8 @@ using namespace ActionCollection;
 SearchLine::SearchLine(QWidget *parent, bool simple)
     : QFrame(parent),
     m_simple(simple),
-    m_searchFieldsBox(0)
+    m_searchFieldsBox(0),
+    m_ignoreAccents(0)
 {
     QHBoxLayout *layout = new QHBoxLayout(this);
     layout->setMargin(0);
@@ -72,12 +85,23 @@ SearchLine::SearchLine(QWidget *parent, bool simple)
         m_caseSensitive->addItem(i18n("Normal Matching"));
         m_caseSensitive->addItem(i18n("Case Sensitive"));
         m_caseSensitive->addItem(i18n("Pattern Matching"));
+        m_caseSensitive->addItem(i18n("Ignore Accents"));
+        m_caseSensitive->addItem(i18n("Number Range"));
         connect(m_caseSensitive, SIGNAL(activated(int)),
                 this, SIGNAL(signalQueryChanged()));
     }
-    else
+    else {
         m_caseSensitive = 0;
 
+        // The search bar has no room for all of the modes, but accents are
+        // often left out when typing.
+
+        m_ignoreAccents = new QCheckBox(i18n("Ignore accents"), this);
+        layout->addWidget(m_ignoreAccents);
+        connect(m_ignoreAccents, SIGNAL(clicked()),
+                this, SIGNAL(signalQueryChanged()));
+    }
+
     updateColumns();
 }
 
@@ -85,6 +109,9 @@ PlaylistSearch::Component SearchLine::searchComponent() const
 {
     QString query = m_lineEdit->text();
     bool caseSensitive = m_caseSensitive && m_caseSensitive->currentIndex() == CaseSensitive;
+    bool ignoreAccents = m_caseSensitive
+        ? m_caseSensitive->currentIndex() == IgnoreAccents
+        : m_ignoreAccents->isChecked();
 
     Playlist *playlist = CollectionList::instance();
 
@@ -99,10 +126,25 @@ PlaylistSearch::Component SearchLine::searchComponent() const
     else
         searchedColumns.append(m_columnList[m_searchFieldsBox->currentIndex() - 1]);
 
-    if(m_caseSensitive && m_caseSensitive->currentIndex() == Pattern)
+    if(m_caseSensitive && m_caseSensitive->currentIndex() == RangeMode) {
+        int minimum;
+        int maximum;
+
+        // Only a single column can be compared, and anything that isn't a
+        // comparison gives a range that matches nothing.
+
+        if(searchedColumns.count() != 1 || !NumberRange::parse(query, &minimum, &maximum)) {
+            minimum = 1;
+            maximum = 0;
+        }
+
+        return PlaylistSearch::Component(searchedColumns.value(0, -1), minimum, maximum);
+    }
+    else if(m_caseSensitive && m_caseSensitive->currentIndex() == Pattern)
         return PlaylistSearch::Component(QRegExp(query), searchedColumns);
     else
-        return PlaylistSearch::Component(query, caseSensitive, searchedColumns);
+        return PlaylistSearch::Component(query, caseSensitive, searchedColumns,
+                                         PlaylistSearch::Component::Contains, ignoreAccents);
 }
 
 void SearchLine::setSearchComponent(const PlaylistSearch::Component &component)
@@ -110,10 +152,21 @@ void SearchLine::setSearchComponent(const PlaylistSearch::Component &component)
     if(component == searchComponent())
         return;
 
-    if(m_simple || !component.isPatternSearch()) {
-        m_lineEdit->setText(component.query());
+    if(component.matchMode() == PlaylistSearch::Component::InRange) {
+        m_lineEdit->setText(formatRange(component));
         if(m_caseSensitive)
-            m_caseSensitive->setCurrentIndex(component.isCaseSensitive() ? CaseSensitive : Default);
+            m_caseSensitive->setCurrentIndex(RangeMode);
+    }
+    else if(m_simple || !component.isPatternSearch()) {
+        m_lineEdit->setText(component.query());
+        if(m_caseSensitive) {
+            if(component.ignoresAccents())
+                m_caseSensitive->setCurrentIndex(IgnoreAccents);
+            else
+                m_caseSensitive->setCurrentIndex(component.isCaseSensitive() ? CaseSensitive : Default);
+        }
+        else
+            m_ignoreAccents->setChecked(component.ignoresAccents());
     }
     else {
         m_lineEdit->setText(component.pattern().pattern());
@@ -241,14 +294,18 @@ QString SearchWidget::searchText() const
 
 void SearchWidget::setSearchText(const QString &text)
 {
-    m_searchLine.setSearchComponent(PlaylistSearch::Component(text));
+    const bool ignoreAccents = m_searchLine.searchComponent().ignoresAccents();
+
+    m_searchLine.setSearchComponent(PlaylistSearch::Component(text, false, ColumnList(),
+                                                              PlaylistSearch::Component::Contains,
+                                                              ignoreAccents));
 }
 
-PlaylistSearch SearchWidget::search(const PlaylistList &playlists) const
+PlaylistSearch SearchWidget::search(const PlaylistList &playlists, bool searchNow) const
 {
     PlaylistSearch::ComponentList components;
     components.append(m_searchLine.searchComponent());
-    return PlaylistSearch(playlists, components);
+    return PlaylistSearch(playlists, components, PlaylistSearch::MatchAny, searchNow);
 }
 
 
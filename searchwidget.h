@@ -25,6 +25,7 @@
 
 #include "playlistsearch.h"
 
+class QCheckBox;
 class QEvent;
 
 class KComboBox;
@@ -38,7 +39,7 @@ class SearchLine : public QFrame
     friend class SearchWidget;
 
 public:
-    enum Mode { Default = 0, CaseSensitive = 1, Pattern = 2 };
+    enum Mode { Default = 0, CaseSensitive = 1, Pattern = 2, IgnoreAccents = 3, RangeMode = 4 };
 
     explicit SearchLine(QWidget *parent, bool simple = false);
 
@@ -66,6 +67,7 @@ private:
     KLineEdit *m_lineEdit;
     KComboBox *m_searchFieldsBox;
     KComboBox *m_caseSensitive;
+    QCheckBox *m_ignoreAccents;
     QList<int> m_columnList;
 };
 
@@ -76,7 +78,7 @@ class SearchWidget : public KToolBar
 public:
     explicit SearchWidget(QWidget *parent);
 
-    PlaylistSearch search(const PlaylistList &playlists) const;
+    PlaylistSearch search(const PlaylistList &playlists, bool searchNow = true) const;
     void setSearch(const PlaylistSearch &search);
 
     virtual QString searchText() const;
@@ -0,0 +1,109 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shufflebag.h"
+
+#include <krandom.h>
+
+////////////////////////////////////////////////////////////////////////////////
+// public methods
+////////////////////////////////////////////////////////////////////////////////
+
+ShuffleBag::ShuffleBag()
+{
+    setSeed(KRandom::random());
+}
+
+void ShuffleBag::fill(const PlaylistItemList &items)
+{
+    clear();
+
+    m_items.reserve(items.count());
+    m_positions.reserve(items.count());
+
+    foreach(PlaylistItem *item, items) {
+        if(!m_positions.contains(item)) {
+            m_positions.insert(item, m_items.count());
+            m_items.append(item);
+        }
+    }
+}
+
+void ShuffleBag::clear()
+{
+    m_items.clear();
+    m_positions.clear();
+}
+
+bool ShuffleBag::contains(const PlaylistItem *item) const
+{
+    return m_positions.contains(item);
+}
+
+PlaylistItem *ShuffleBag::pick()
+{
+    return m_items[nextRandom() % m_items.count()];
+}
+
+PlaylistItem *ShuffleBag::draw()
+{
+    PlaylistItem *item = pick();
+    remove(item);
+    return item;
+}
+
+void ShuffleBag::remove(const PlaylistItem *item)
+{
+    QHash<const PlaylistItem *, int>::Iterator it = m_positions.find(item);
+
+    if(it == m_positions.end())
+        return;
+
+    // The last item takes the place of the one removed, so that nothing has
+    // to be moved along.
+
+    const int position = it.value();
+    const int last = m_items.count() - 1;
+
+    m_positions.erase(it);
+
+    if(position != last) {
+        m_items[position] = m_items[last];
+        m_positions[m_items[position]] = position;
+    }
+
+    m_items.resize(last);
+}
+
+void ShuffleBag::setSeed(quint32 seed)
+{
+    // xorshift gets stuck at 0.
+
+    m_state = seed != 0 ? seed : 0x9e3779b9;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private methods
+////////////////////////////////////////////////////////////////////////////////
+
+quint32 ShuffleBag::nextRandom()
+{
+    m_state ^= m_state << 13;
+    m_state ^= m_state >> 17;
+    m_state ^= m_state << 5;
+
+    return m_state;
+}
+
+// vim: set et sw=4 tw=0 sta:
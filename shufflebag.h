@@ -0,0 +1,78 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_SHUFFLEBAG_H
+#define JUK_SHUFFLEBAG_H
+
+#include <QHash>
+#include <QVector>
+
+#include "playlistitem.h"
+
+/**
+ * The items left to be played in random play.  Items are drawn one at a time
+ * in random order, as in a Fisher-Yates shuffle, and any item can be taken out
+ * early, e.g. because it's about to be deleted.  Both take constant time.
+ *
+ * The bag has its own random number generator, so that a given seed always
+ * gives the same order for the same items.
+ */
+class ShuffleBag
+{
+public:
+    /**
+     * Creates an empty bag seeded from KRandom.
+     */
+    ShuffleBag();
+
+    /**
+     * Replaces the contents of the bag with \a items.
+     */
+    void fill(const PlaylistItemList &items);
+    void clear();
+
+    bool isEmpty() const { return m_items.isEmpty(); }
+    int count() const { return m_items.count(); }
+    bool contains(const PlaylistItem *item) const;
+
+    /**
+     * Returns a random item from the bag, leaving it in the bag.  The bag must
+     * not be empty.
+     */
+    PlaylistItem *pick();
+
+    /**
+     * Returns a random item from the bag and takes it out.  The bag must not
+     * be empty.
+     */
+    PlaylistItem *draw();
+
+    /**
+     * Takes \a item out of the bag, if it's in it.
+     */
+    void remove(const PlaylistItem *item);
+
+    void setSeed(quint32 seed);
+
+private:
+    quint32 nextRandom();
+
+    QVector<PlaylistItem *> m_items;
+    QHash<const PlaylistItem *, int> m_positions;
+    quint32 m_state;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
@@ -29,21 +29,33 @@
 
 #include "cache.h"
 #include "mediafiles.h"
-#include "stringshare.h"
+
+static QString formatLength(int length)
+{
+    const int seconds = length % 60;
+    const int minutes = (length - seconds) / 60;
+
+    return QString::number(minutes) + (seconds >= 10 ? ":" : ":0") + QString::number(seconds);
+}
+
+static QString tagString(const TagLib::String &value)
+{
+    // The string is interned and kept as long as any track uses it.
+
+    QString string = TStringToQString(value).trimmed();
+    string.squeeze();
+    return string;
+}
 
 ////////////////////////////////////////////////////////////////////////////////
 // public members
 ////////////////////////////////////////////////////////////////////////////////
 
-
 Tag::Tag(const QString &fileName) :
-    m_fileName(fileName),
-    m_track(0),
-    m_year(0),
-    m_seconds(0),
-    m_bitrate(0),
-    m_isValid(false)
+    m_row(store()->createRow())
 {
+    setFileName(fileName);
+
     if(fileName.isEmpty()) {
         kError() << "Trying to add empty file, backtrace follows:" << endl;
         kError() << kBacktrace(10) << endl;
@@ -61,20 +73,42 @@ Tag::Tag(const QString &fileName) :
     }
 }
 
+Tag::Tag(const Tag &tag) :
+    m_row(store()->copyRow(tag.m_row))
+{
+
+}
+
+Tag::~Tag()
+{
+    store()->releaseRow(m_row);
+}
+
+Tag &Tag::operator=(const Tag &tag)
+{
+    if(&tag != this) {
+        const int row = store()->copyRow(tag.m_row);
+        store()->releaseRow(m_row);
+        m_row = row;
+    }
+
+    return *this;
+}
+
 bool Tag::save()
 {
     bool result;
     TagLib::ID3v2::FrameFactory::instance()->setDefaultTextEncoding(TagLib::String::UTF8);
-    TagLib::File *file = MediaFiles::fileFactoryByType(m_fileName);
+    TagLib::File *file = MediaFiles::fileFactoryByType(fileName());
 
     if(file && !file->readOnly() && file->isValid() && file->tag()) {
-        file->tag()->setTitle(TagLib::String(m_title.toUtf8().constData(), TagLib::String::UTF8));
-        file->tag()->setArtist(TagLib::String(m_artist.toUtf8().constData(), TagLib::String::UTF8));
-        file->tag()->setAlbum(TagLib::String(m_album.toUtf8().constData(), TagLib::String::UTF8));
-        file->tag()->setGenre(TagLib::String(m_genre.toUtf8().constData(), TagLib::String::UTF8));
-        file->tag()->setComment(TagLib::String(m_comment.toUtf8().constData(), TagLib::String::UTF8));
-        file->tag()->setTrack(m_track);
-        file->tag()->setYear(m_year);
+        file->tag()->setTitle(TagLib::String(title().toUtf8().constData(), TagLib::String::UTF8));
+        file->tag()->setArtist(TagLib::String(artist().toUtf8().constData(), TagLib::String::UTF8));
+        file->tag()->setAlbum(TagLib::String(album().toUtf8().constData(), TagLib::String::UTF8));
+        file->tag()->setGenre(TagLib::String(genre().toUtf8().constData(), TagLib::String::UTF8));
+        file->tag()->setComment(TagLib::String(comment().toUtf8().constData(), TagLib::String::UTF8));
+        file->tag()->setTrack(track());
+        file->tag()->setYear(year());
         result = file->save();
     }
     else {
@@ -86,6 +120,11 @@ bool Tag::save()
     return result;
 }
 
+QString Tag::lengthString() const
+{
+    return formatLength(seconds());
+}
+
 QString Tag::playingString() const
 {
     QString str;
@@ -101,60 +140,78 @@ QString Tag::playingString() const
 
 CacheDataStream &Tag::read(CacheDataStream &s)
 {
+    QString title;
+    QString artist;
+    QString album;
+    QString genre;
+    QString comment;
+
     switch(s.cacheVersion()) {
     case 1: {
         qint32 track;
         qint32 year;
         qint32 bitrate;
         qint32 seconds;
+        QString length;
 
-        s >> m_title
-          >> m_artist
-          >> m_album
-          >> m_genre
+        s >> title
+          >> artist
+          >> album
+          >> genre
           >> track
           >> year
-          >> m_comment
+          >> comment
           >> bitrate
-          >> m_lengthString
+          >> length
           >> seconds;
 
-        m_track = track;
-        m_year = year;
-        m_bitrate = bitrate;
-        m_seconds = seconds;
+        setTrack(track);
+        setYear(year);
+        store()->setBitrate(m_row, bitrate);
+        store()->setSeconds(m_row, seconds);
         break;
     }
     default: {
         static QString dummyString;
         static int dummyInt;
+        int track;
+        int year;
+        int seconds;
         QString bitrateString;
 
         s >> dummyInt
-          >> m_title
-          >> m_artist
-          >> m_album
-          >> m_genre
+          >> title
+          >> artist
+          >> album
+          >> genre
           >> dummyInt
-          >> m_track
+          >> track
           >> dummyString
-          >> m_year
+          >> year
           >> dummyString
-          >> m_comment
+          >> comment
           >> bitrateString
-          >> m_lengthString
-          >> m_seconds
+          >> dummyString
+          >> seconds
           >> dummyString;
 
+        setTrack(track);
+        setYear(year);
+        store()->setSeconds(m_row, seconds);
+
         bool ok;
-        m_bitrate = bitrateString.toInt(&ok);
-        if(!ok)
-            m_bitrate = 0;
+        const int bitrate = bitrateString.toInt(&ok);
+        store()->setBitrate(m_row, ok ? bitrate : 0);
         break;
     }
     }
 
-    minimizeMemoryUsage();
+    setTitle(title);
+    setArtist(artist);
+    setAlbum(album);
+    setGenre(genre);
+    setComment(comment);
+
     return s;
 }
 
@@ -163,61 +220,63 @@ CacheDataStream &Tag::read(CacheDataStream &s)
 ////////////////////////////////////////////////////////////////////////////////
 
 Tag::Tag(const QString &fileName, bool) :
-    m_fileName(fileName),
-    m_track(0),
-    m_year(0),
-    m_seconds(0),
-    m_bitrate(0),
-    m_isValid(true)
+    m_row(store()->createRow())
 {
+    setFileName(fileName);
+    store()->setValid(m_row, true);
+}
 
+Tag::Tag(const QString &fileName, const CacheRecord *record) :
+    m_row(store()->createRow())
+{
+    // The strings point straight into the mapped cache file, so interning
+    // them doesn't copy their text.
+
+    const Cache *cache = Cache::instance();
+
+    setFileName(fileName);
+    setTitle(cache->cachedString(record->title));
+    setArtist(cache->cachedString(record->artist));
+    setAlbum(cache->cachedString(record->album));
+    setGenre(cache->cachedString(record->genre));
+    setComment(cache->cachedString(record->comment));
+    setTrack(record->track);
+    setYear(record->year);
+
+    store()->setSeconds(m_row, record->seconds);
+    store()->setBitrate(m_row, record->bitrate);
+    store()->setValid(m_row, true);
 }
 
 void Tag::setup(TagLib::File *file)
 {
+    const QString fileName = this->fileName();
+
     if(!file || !file->tag()) {
-        kWarning() << "Can't setup invalid file" << m_fileName;
+        kWarning() << "Can't setup invalid file" << fileName;
         return;
     }
 
-    m_title   = TStringToQString(file->tag()->title()).trimmed();
-    m_artist  = TStringToQString(file->tag()->artist()).trimmed();
-    m_album   = TStringToQString(file->tag()->album()).trimmed();
-    m_genre   = TStringToQString(file->tag()->genre()).trimmed();
-    m_comment = TStringToQString(file->tag()->comment()).trimmed();
-
-    m_track = file->tag()->track();
-    m_year  = file->tag()->year();
-
-    m_seconds = file->audioProperties()->length();
-    m_bitrate = file->audioProperties()->bitrate();
+    QString title = tagString(file->tag()->title());
 
-    const int seconds = m_seconds % 60;
-    const int minutes = (m_seconds - seconds) / 60;
-
-    m_lengthString = QString::number(minutes) + (seconds >= 10 ? ":" : ":0") + QString::number(seconds);
-
-    if(m_title.isEmpty()) {
-        int i = m_fileName.lastIndexOf('/');
-        int j = m_fileName.lastIndexOf('.');
-        m_title = i > 0 ? m_fileName.mid(i + 1, j - i - 1) : m_fileName;
+    if(title.isEmpty()) {
+        int i = fileName.lastIndexOf('/');
+        int j = fileName.lastIndexOf('.');
+        title = i > 0 ? fileName.mid(i + 1, j - i - 1) : fileName;
     }
 
-    minimizeMemoryUsage();
-    m_isValid = true;
-}
-
-void Tag::minimizeMemoryUsage()
-{
-    // Try to reduce memory usage: share tags that frequently repeat, squeeze others
+    setTitle(title);
+    setArtist(tagString(file->tag()->artist()));
+    setAlbum(tagString(file->tag()->album()));
+    setGenre(tagString(file->tag()->genre()));
+    setComment(tagString(file->tag()->comment()));
 
-    m_title.squeeze();
-    m_lengthString.squeeze();
+    setTrack(file->tag()->track());
+    setYear(file->tag()->year());
 
-    m_comment = StringShare::tryShare(m_comment);
-    m_artist  = StringShare::tryShare(m_artist);
-    m_album   = StringShare::tryShare(m_album);
-    m_genre   = StringShare::tryShare(m_genre);
+    store()->setSeconds(m_row, file->audioProperties()->length());
+    store()->setBitrate(m_row, file->audioProperties()->bitrate());
+    store()->setValid(m_row, true);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
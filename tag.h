@@ -18,15 +18,19 @@
 #ifndef TAG_H
 #define TAG_H
 
-#include <QDateTime>
+#include <QString>
+
+#include "trackstore.h"
 
 namespace TagLib { class File; }
 
 class CacheDataStream;
+struct CacheRecord;
 
 /*!
  * This should really be called "metadata" and may at some point be titled as
- * such.  Right now it's mostly a Qt wrapper around TagLib.
+ * such.  Right now it's mostly a Qt wrapper around TagLib.  The fields are
+ * kept in a row of the TrackStore, which each Tag owns.
  */
 
 class Tag
@@ -38,39 +42,55 @@ public:
      * Create an empty tag.  Used in FileHandle for cache restoration.
      */
     Tag(const QString &fileName, bool);
+    /**
+     * Create a tag backed by a record of the mapped music cache.  The strings
+     * point straight into the mapping rather than being copied.
+     */
+    Tag(const QString &fileName, const CacheRecord *record);
+    Tag(const Tag &tag);
+    ~Tag();
+
+    Tag &operator=(const Tag &tag);
 
     bool save();
 
-    QString title() const { return m_title; }
-    QString artist() const { return m_artist; }
-    QString album() const { return m_album; }
-    QString genre() const { return m_genre; }
-    int track() const { return m_track; }
-    int year() const { return m_year; }
-    QString comment() const { return m_comment; }
+    QString title() const { return store()->text(m_row, TrackStore::Title); }
+    QString artist() const { return store()->text(m_row, TrackStore::Artist); }
+    QString album() const { return store()->text(m_row, TrackStore::Album); }
+    QString genre() const { return store()->text(m_row, TrackStore::Genre); }
+    int track() const { return store()->track(m_row); }
+    int year() const { return store()->year(m_row); }
+    QString comment() const { return store()->text(m_row, TrackStore::Comment); }
 
-    QString fileName() const { return m_fileName; }
+    QString fileName() const { return store()->fileName(m_row); }
 
-    void setTitle(const QString &value) { m_title = value; }
-    void setArtist(const QString &value) { m_artist = value; }
-    void setAlbum(const QString &value) { m_album = value; }
-    void setGenre(const QString &value) { m_genre = value; }
-    void setTrack(int value) { m_track = value; }
-    void setYear(int value) { m_year = value; }
-    void setComment(const QString &value) { m_comment = value; }
+    void setTitle(const QString &value) { store()->setText(m_row, TrackStore::Title, value); }
+    void setArtist(const QString &value) { store()->setText(m_row, TrackStore::Artist, value); }
+    void setAlbum(const QString &value) { store()->setText(m_row, TrackStore::Album, value); }
+    void setGenre(const QString &value) { store()->setText(m_row, TrackStore::Genre, value); }
+    void setTrack(int value) { store()->setTrack(m_row, value); }
+    void setYear(int value) { store()->setYear(m_row, value); }
+    void setComment(const QString &value) { store()->setText(m_row, TrackStore::Comment, value); }
 
-    void setFileName(const QString &value) { m_fileName = value; }
+    void setFileName(const QString &value) { store()->setFileName(m_row, value); }
 
-    int seconds() const { return m_seconds; }
-    int bitrate() const { return m_bitrate; }
+    int seconds() const { return store()->seconds(m_row); }
+    int bitrate() const { return store()->bitrate(m_row); }
 
-    bool isValid() const { return m_isValid; }
+    bool isValid() const { return store()->isValid(m_row); }
+
+    /**
+     * Returns the id of the interned string in \a field, which identifies the
+     * sort and search keys that the TrackStore keeps for it.
+     */
+    TrackStore::StringId textId(TrackStore::TextField field) const { return store()->textId(m_row, field); }
 
     /**
      * As a convenience, since producing a length string from a number of second
-     * isn't a one liner, provide the length in string form.
+     * isn't a one liner, provide the length in string form.  This is built on
+     * demand rather than stored with every track.
      */
-    QString lengthString() const { return m_lengthString; }
+    QString lengthString() const;
 
     /**
      * Convenience function to return a concise string describing the track,
@@ -81,22 +101,11 @@ public:
     CacheDataStream &read(CacheDataStream &s);
 
 private:
+    static TrackStore *store() { return TrackStore::instance(); }
+
     void setup(TagLib::File *file);
-    void minimizeMemoryUsage();
-
-    QString m_fileName;
-    QString m_title;
-    QString m_artist;
-    QString m_album;
-    QString m_genre;
-    QString m_comment;
-    int m_track;
-    int m_year;
-    int m_seconds;
-    int m_bitrate;
-    QDateTime m_modificationTime;
-    QString m_lengthString;
-    bool m_isValid;
+
+    int m_row;
 };
 
 QDataStream &operator<<(QDataStream &s, const Tag &t);
@@ -177,7 +177,12 @@ bool TagTransactionManager::processChangeList(bool undo)
             if(!undo)
                 m_undoList.append(TagTransactionAtom(item, duplicateTag(item->file().tag())));
 
+            // Keep the collection (and its cache journal) in sync with the
+            // new file name before reading the tag back.
+
+            QString oldPath = item->file().absFilePath();
             item->file().setFile(tag->fileName());
+            item->collectionItem()->updateCollectionDict(oldPath, item->file().absFilePath());
             item->refreshFromDisk();
             item->repaint();
             item->playlist()->dataChanged();
@@ -0,0 +1,199 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "cache.h"
+#include "crc32c.h"
+#include "filehandle.h"
+#include "tag.h"
+
+#include <kstandarddirs.h>
+#include <ktempdir.h>
+#include <qtest_kde.h>
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+
+#include <stddef.h>
+
+// Enough tracks for two blocks of records, see cacheRecordsPerBlock.
+
+static const int trackCount = 300;
+static const int recordsPerBlock = 256;
+
+class CacheTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void testCrc32c();
+    void testCache();
+
+private:
+    QString trackPath(int i) const;
+    FileHandle createTrack(int i, const QString &title) const;
+    void damageRecord(int i) const;
+
+    KTempDir m_dir;
+    QString m_folder;
+};
+
+void CacheTest::initTestCase()
+{
+    QVERIFY(m_dir.exists());
+    m_folder = QFileInfo(m_dir.name()).canonicalFilePath();
+
+    const QString cacheFolder = KGlobal::dirs()->saveLocation("appdata");
+    QFile::remove(cacheFolder + "cache");
+    QFile::remove(cacheFolder + "cache-journal");
+}
+
+void CacheTest::testCrc32c()
+{
+    const QByteArray check("123456789");
+
+    QCOMPARE(crc32cSoftware(check.constData(), check.size()), quint32(0xe3069283));
+    QCOMPARE(crc32cSoftware(check.constData(), 0), quint32(0));
+
+    if(!crc32cHardwareAvailable())
+        QSKIP("The CPU doesn't support SSE4.2", SkipSingle);
+
+    QCOMPARE(crc32cHardware(check.constData(), check.size()), quint32(0xe3069283));
+
+    // The hardware version works on unaligned heads and tails separately.
+
+    QByteArray data;
+    for(int i = 0; i < 1000; ++i)
+        data.append(char(i * 7));
+
+    for(int offset = 0; offset < 9; ++offset) {
+        const char *start = data.constData() + offset;
+        const quint64 length = data.size() - offset * 2;
+
+        QCOMPARE(crc32cHardware(start, length), crc32cSoftware(start, length));
+    }
+}
+
+void CacheTest::testCache()
+{
+    Cache *cache = Cache::instance();
+
+    FileHandleList files;
+    for(int i = 0; i < trackCount; ++i)
+        files.append(createTrack(i, QString("Title %1").arg(i)));
+
+    QVERIFY(Cache::saveCachedItems(files));
+
+    // Record 260 is in the second block, which is dropped as a whole.
+
+    damageRecord(260);
+
+    // Changes after the cache was saved go into the journal.
+
+    const QString renamedPath = m_folder + "/renamed.mp3";
+    QVERIFY(QFile::rename(trackPath(3), renamedPath));
+
+    cache->journalUpdate(createTrack(1, "Updated"));
+    cache->journalRemove(trackPath(2));
+    cache->journalRename(trackPath(3), renamedPath);
+    cache->closeJournal();
+
+    QVERIFY(cache->prepareToLoadCachedItems());
+
+    QHash<QString, FileHandle> loaded;
+    for(FileHandle file = cache->loadNextCachedItem(); !file.isNull(); file = cache->loadNextCachedItem())
+        loaded.insert(file.absFilePath(), file);
+
+    QCOMPARE(loaded.count(), recordsPerBlock - 1);
+
+    const FileHandle first = loaded.value(trackPath(0));
+    QVERIFY(!first.isNull());
+    QCOMPARE(first.tag()->title(), QString("Title 0"));
+    QCOMPARE(first.tag()->artist(), QString("Artist"));
+    QCOMPARE(first.tag()->album(), QString("Album 0"));
+    QCOMPARE(first.tag()->track(), 1);
+    QCOMPARE(first.tag()->year(), 1999);
+
+    QCOMPARE(loaded.value(trackPath(1)).tag()->title(), QString("Updated"));
+    QVERIFY(!loaded.contains(trackPath(2)));
+    QVERIFY(!loaded.contains(trackPath(3)));
+    QCOMPARE(loaded.value(renamedPath).tag()->title(), QString("Title 3"));
+    QCOMPARE(loaded.value(trackPath(recordsPerBlock - 1)).tag()->title(),
+             QString("Title %1").arg(recordsPerBlock - 1));
+
+    for(int i = recordsPerBlock; i < trackCount; ++i)
+        QVERIFY(!loaded.contains(trackPath(i)));
+
+    // Tracks can still be looked up by path, except in the damaged block.
+
+    Tag *tag = cache->cachedTag(FileHandle(trackPath(10)));
+    QVERIFY(tag);
+    QCOMPARE(tag->title(), QString("Title 10"));
+    delete tag;
+
+    QVERIFY(!cache->cachedTag(FileHandle(trackPath(270))));
+
+    QVERIFY(cache->journalNeedsCompaction());
+}
+
+QString CacheTest::trackPath(int i) const
+{
+    return m_folder + QString("/track%1.mp3").arg(i, 3, 10, QChar('0'));
+}
+
+FileHandle CacheTest::createTrack(int i, const QString &title) const
+{
+    const QString path = trackPath(i);
+
+    QFile file(path);
+    if(!file.exists()) {
+        file.open(QIODevice::WriteOnly);
+        file.close();
+    }
+
+    Tag *tag = new Tag(path, true);
+    tag->setTitle(title);
+    tag->setArtist("Artist");
+    tag->setAlbum(QString("Album %1").arg(i / 10));
+    tag->setTrack(i % 10 + 1);
+    tag->setYear(1999);
+
+    return FileHandle(path, tag, QFileInfo(path).lastModified());
+}
+
+void CacheTest::damageRecord(int i) const
+{
+    QFile file(KGlobal::dirs()->saveLocation("appdata") + "cache");
+    QVERIFY(file.open(QIODevice::ReadWrite));
+
+    CacheHeader header;
+    QCOMPARE(file.read(reinterpret_cast<char *>(&header), sizeof(CacheHeader)),
+             qint64(sizeof(CacheHeader)));
+
+    const qint64 offset = header.recordOffset + i * sizeof(CacheRecord) + offsetof(CacheRecord, track);
+    char byte;
+
+    QVERIFY(file.seek(offset));
+    QVERIFY(file.getChar(&byte));
+    QVERIFY(file.seek(offset));
+    QVERIFY(file.putChar(byte ^ 0x40));
+}
+
+QTEST_KDEMAIN_CORE(CacheTest)
+
+// vim: set et sw=4 tw=0 sta:
+
+#include "cachetest.moc"
@@ -1,6 +1,4 @@
 /**
- * Copyright (C) 2003 Maksim Orlovich <maksim.orlovich@kdemail.net>
- *
  * This program is free software; you can redistribute it and/or modify it under
  * the terms of the GNU General Public License as published by the Free Software
  * Foundation; either version 2 of the License, or (at your option) any later
@@ -14,25 +12,21 @@
  * this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
-#ifndef STRING_SHARE_H
-#define STRING_SHARE_H
+#ifndef JUK_FAKEPOINTER_H
+#define JUK_FAKEPOINTER_H
 
-class QString;
+#include <QtGlobal>
 
 /**
- * This class attempts to normalize repeated occurrences of strings to use
- *the same shared object, if possible, by using a small hash
+ * Returns a distinct, never dereferenced pointer to a T for each \p i, for
+ * testing containers that only compare and hash the pointers they're given,
+ * without having to construct the objects, which would need the whole GUI.
  */
-class StringShare
+template <class T>
+T *fakePointer(int i)
 {
-    struct Data;
-public:
-    static QString tryShare(const QString& in);
-
-private:
-    static Data* data();
-    static Data* s_data;
-};
+    return reinterpret_cast<T *>(quintptr(i + 1) * 16);
+}
 
 #endif
 
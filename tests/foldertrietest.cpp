@@ -0,0 +1,135 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "foldertrie.h"
+#include <qtest_kde.h>
+
+class FolderTrieTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testMembership_data();
+    void testMembership();
+    void testSetFolders();
+
+private:
+    void add(const QString &path, FolderTrie::Membership membership);
+};
+
+void FolderTrieTest::testMembership_data()
+{
+    QTest::addColumn<QString>("path");
+    QTest::addColumn<int>("membership");
+
+    // Plain music folder.
+
+    add("/music", FolderTrie::Included);
+    add("/music/", FolderTrie::Included);
+    add("/music/a.mp3", FolderTrie::Included);
+    add("/music/Artist/Album/01.ogg", FolderTrie::Included);
+
+    // Folders whose names only start with the name of a music folder.
+
+    add("/music2", FolderTrie::Outside);
+    add("/music2/a.mp3", FolderTrie::Outside);
+    add("/musi", FolderTrie::Outside);
+    add("/", FolderTrie::Outside);
+    add("/home/music/a.mp3", FolderTrie::Outside);
+
+    // Excluded folder inside of the music folder, given with a trailing slash.
+
+    add("/music/podcasts", FolderTrie::Excluded);
+    add("/music/podcasts/", FolderTrie::Excluded);
+    add("/music/podcasts/show/1.mp3", FolderTrie::Excluded);
+    add("/music/podcasts2/1.mp3", FolderTrie::Included);
+
+    // Music folder inside of that excluded folder: the innermost folder
+    // decides, and that goes on to any depth.
+
+    add("/music/podcasts/keep", FolderTrie::Included);
+    add("/music/podcasts/keep/1.mp3", FolderTrie::Included);
+    add("/music/podcasts/keep/old", FolderTrie::Excluded);
+    add("/music/podcasts/keep/old/1.mp3", FolderTrie::Excluded);
+    add("/music/podcasts/keeper/1.mp3", FolderTrie::Excluded);
+
+    // Excluded folder that isn't inside of any music folder.
+
+    add("/tmp/a.mp3", FolderTrie::Excluded);
+    add("/tmpfiles/a.mp3", FolderTrie::Outside);
+
+    // Duplicate slashes don't change anything.
+
+    add("//music//podcasts//keep//1.mp3", FolderTrie::Included);
+}
+
+void FolderTrieTest::testMembership()
+{
+    QFETCH(QString, path);
+    QFETCH(int, membership);
+
+    FolderTrie trie;
+    trie.setFolders(QStringList() << "/music" << "/music/podcasts/keep/",
+                    QStringList() << "/music/podcasts/" << "/music/podcasts/keep/old" << "/tmp");
+
+    QCOMPARE(int(trie.membership(path)), membership);
+    QCOMPARE(trie.isExcluded(path), membership == FolderTrie::Excluded);
+}
+
+void FolderTrieTest::testSetFolders()
+{
+    FolderTrie trie;
+
+    QCOMPARE(trie.membership("/music/a.mp3"), FolderTrie::Outside);
+    QVERIFY(!trie.hasExcludedFolders());
+
+    // Excluded folders win over the same folder in the music folders.
+
+    trie.setFolders(QStringList() << "/music" << "/music/live",
+                    QStringList() << "/music/live");
+
+    QVERIFY(trie.hasExcludedFolders());
+    QCOMPARE(trie.membership("/music/a.mp3"), FolderTrie::Included);
+    QCOMPARE(trie.membership("/music/live/a.mp3"), FolderTrie::Excluded);
+
+    // Setting the folders again replaces the old ones.
+
+    trie.setFolders(QStringList() << "/other", QStringList());
+
+    QVERIFY(!trie.hasExcludedFolders());
+    QCOMPARE(trie.membership("/music/a.mp3"), FolderTrie::Outside);
+    QCOMPARE(trie.membership("/music/live/a.mp3"), FolderTrie::Outside);
+    QCOMPARE(trie.membership("/other/a.mp3"), FolderTrie::Included);
+
+    // The root folder contains everything.
+
+    trie.setFolders(QStringList() << "/", QStringList() << "/proc");
+
+    QCOMPARE(trie.membership("/music/a.mp3"), FolderTrie::Included);
+    QCOMPARE(trie.membership("/proc/1"), FolderTrie::Excluded);
+}
+
+void FolderTrieTest::add(const QString &path, FolderTrie::Membership membership)
+{
+    QTest::newRow(path.toUtf8())
+        << path
+        << int(membership)
+    ;
+}
+
+QTEST_KDEMAIN_CORE(FolderTrieTest)
+
+// vim: set et sw=4 tw=0 sta:
+
+#include "foldertrietest.moc"
@@ -0,0 +1,160 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "numberrange.h"
+#include <qtest_kde.h>
+
+class NumberRangeTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testParse_data();
+    void testParse();
+    void testMalformed_data();
+    void testMalformed();
+    void testRoundTrip_data();
+    void testRoundTrip();
+
+private:
+    void add(const QString &text, int minimum, int maximum);
+};
+
+void NumberRangeTest::testParse_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("minimum");
+    QTest::addColumn<int>("maximum");
+
+    add("1990", 1990, 1990);
+    add("= 3", 3, 3);
+    add("  =3  ", 3, 3);
+    add(">= 1990", 1990, NumberRange::noMaximum);
+    add(">1990", 1991, NumberRange::noMaximum);
+    add("<= 192", 0, 192);
+    add("< 192", 0, 191);
+    add("< 0", 0, -1);
+    add("1990 - 1999", 1990, 1999);
+    add("1990-1999", 1990, 1999);
+    add("3:00 - 5:00", 180, 300);
+    add("between 1990 and 1999", 1990, 1999);
+    add("Between 3:00 AND 5:00", 180, 300);
+    add(">= 1:02:03", 3723, NumberRange::noMaximum);
+    add(">= 2147483647", NumberRange::noMaximum, NumberRange::noMaximum);
+}
+
+void NumberRangeTest::testParse()
+{
+    QFETCH(QString, text);
+    QFETCH(int, minimum);
+    QFETCH(int, maximum);
+
+    int parsedMinimum = -1;
+    int parsedMaximum = -1;
+
+    QVERIFY(NumberRange::parse(text, &parsedMinimum, &parsedMaximum));
+    QCOMPARE(parsedMinimum, minimum);
+    QCOMPARE(parsedMaximum, maximum);
+}
+
+void NumberRangeTest::testMalformed_data()
+{
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("empty") << QString();
+    QTest::newRow("blank") << QString("   ");
+    QTest::newRow("word") << QString("nineties");
+    QTest::newRow("trailing word") << QString("1990s");
+    QTest::newRow("decimal") << QString("1.5");
+    QTest::newRow("negative") << QString("-5");
+    QTest::newRow("comparison only") << QString(">=");
+    QTest::newRow("equals only") << QString("=");
+    QTest::newRow("open range") << QString("1990 -");
+    QTest::newRow("three bounds") << QString("1 - 2 - 3");
+    QTest::newRow("open between") << QString("between 1990 and");
+    QTest::newRow("between without and") << QString("between 1990 1999");
+    QTest::newRow("double comparison") << QString(">> 3");
+    QTest::newRow("empty seconds") << QString("3:");
+    QTest::newRow("too many colons") << QString("1:2:3:4");
+    QTest::newRow("too large") << QString("2147483648");
+    QTest::newRow("too large length") << QString("99999999:00");
+    QTest::newRow("above maximum") << QString("> 2147483647");
+}
+
+void NumberRangeTest::testMalformed()
+{
+    QFETCH(QString, text);
+
+    int minimum;
+    int maximum;
+
+    QVERIFY(!NumberRange::parse(text, &minimum, &maximum));
+}
+
+void NumberRangeTest::testRoundTrip_data()
+{
+    QTest::addColumn<int>("minimum");
+    QTest::addColumn<int>("maximum");
+    QTest::addColumn<bool>("isLength");
+    QTest::addColumn<QString>("text");
+
+    QTest::newRow("single") << 1990 << 1990 << false << QString("1990");
+    QTest::newRow("zero") << 0 << 0 << false << QString("<= 0");
+    QTest::newRow("at least") << 128 << NumberRange::noMaximum << false << QString(">= 128");
+    QTest::newRow("everything") << 0 << NumberRange::noMaximum << false << QString(">= 0");
+    QTest::newRow("at most") << 0 << 320 << false << QString("<= 320");
+    QTest::newRow("between") << 1990 << 1999 << false << QString("1990 - 1999");
+    QTest::newRow("length") << 180 << 305 << true << QString("3:00 - 5:05");
+    QTest::newRow("short length") << 0 << 59 << true << QString("<= 0:59");
+    QTest::newRow("long length") << 3723 << NumberRange::noMaximum << true << QString(">= 62:03");
+}
+
+void NumberRangeTest::testRoundTrip()
+{
+    QFETCH(int, minimum);
+    QFETCH(int, maximum);
+    QFETCH(bool, isLength);
+    QFETCH(QString, text);
+
+    QCOMPARE(NumberRange::format(minimum, maximum, isLength), text);
+
+    int parsedMinimum = -1;
+    int parsedMaximum = -1;
+
+    QVERIFY(NumberRange::parse(text, &parsedMinimum, &parsedMaximum));
+    QCOMPARE(parsedMinimum, minimum);
+    QCOMPARE(parsedMaximum, maximum);
+
+    // Ranges that contain nothing, like the one used for malformed searches,
+    // give no text, which doesn't parse either.
+
+    QVERIFY(NumberRange::format(1, 0, isLength).isEmpty());
+    QVERIFY(NumberRange::format(0, -1, isLength).isEmpty());
+    QVERIFY(!NumberRange::parse(NumberRange::format(1, 0, isLength), &parsedMinimum, &parsedMaximum));
+}
+
+void NumberRangeTest::add(const QString &text, int minimum, int maximum)
+{
+    QTest::newRow(text.toUtf8())
+        << text
+        << minimum
+        << maximum
+    ;
+}
+
+QTEST_KDEMAIN_CORE(NumberRangeTest)
+
+// vim: set et sw=4 tw=0 sta:
+
+#include "numberrangetest.moc"
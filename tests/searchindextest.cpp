@@ -0,0 +1,284 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "searchindex.h"
+#include "playlistitem.h"
+#include "fakepointer.h"
+#include <qtest_kde.h>
+
+typedef PlaylistSearch::Component Component;
+
+static CollectionListItem *fakeItem(int i)
+{
+    return fakePointer<CollectionListItem>(i);
+}
+
+static QStringList keys(const QString &track, const QString &artist = QString(),
+                        const QString &album = QString(), const QString &comment = QString())
+{
+    QStringList result;
+
+    for(int column = 0; column < PlaylistItem::FileNameColumn; ++column)
+        result.append(QString());
+
+    result[PlaylistItem::TrackColumn] = track;
+    result[PlaylistItem::ArtistColumn] = artist;
+    result[PlaylistItem::AlbumColumn] = album;
+    result[PlaylistItem::CommentColumn] = comment;
+
+    return result;
+}
+
+static ColumnList columns(int first, int second = -1)
+{
+    ColumnList result;
+    result.append(first);
+
+    if(second >= 0)
+        result.append(second);
+
+    return result;
+}
+
+static SearchIndex::ItemSet itemSet(int first, int second = -1, int third = -1)
+{
+    SearchIndex::ItemSet result;
+    result.insert(fakeItem(first));
+
+    if(second >= 0)
+        result.insert(fakeItem(second));
+    if(third >= 0)
+        result.insert(fakeItem(third));
+
+    return result;
+}
+
+class SearchIndexTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void init();
+    void testWords();
+    void testTrigrams();
+    void testColumns();
+    void testNotIndexed();
+    void testInsertAgain();
+    void testCompaction();
+
+private:
+    SearchIndex::ItemSet find(const QString &query, Component::MatchMode mode,
+                              const ColumnList &columns, bool *found = 0) const;
+
+    SearchIndex m_index;
+};
+
+void SearchIndexTest::init()
+{
+    m_index.clear();
+
+    m_index.insert(fakeItem(0), keys("come together", "the beatles", "abbey road"));
+    m_index.insert(fakeItem(1), keys("gimme shelter", "the rolling stones", "let it bleed"));
+    m_index.insert(fakeItem(2), keys("road to nowhere", "talking heads", "little creatures"));
+    m_index.insert(fakeItem(3), keys("abbey road medley", "the beatles tribute band", "live"));
+}
+
+void SearchIndexTest::testWords()
+{
+    const ColumnList all = columns(PlaylistItem::TrackColumn, PlaylistItem::AlbumColumn);
+
+    QCOMPARE(find("road", Component::ContainsWord, all), itemSet(0, 2, 3));
+    QCOMPARE(find("road", Component::Exact, all), itemSet(0, 2, 3));
+
+    // Every word has to be found in the same column of an item.
+
+    QCOMPARE(find("abbey road", Component::ContainsWord, all), itemSet(0, 3));
+    QCOMPARE(find("road abbey", Component::ContainsWord, all), itemSet(0, 3));
+    QCOMPARE(find("road nowhere", Component::ContainsWord, all), itemSet(2));
+    QCOMPARE(find("road bleed", Component::ContainsWord, all), SearchIndex::ItemSet());
+    QCOMPARE(find("beatles road", Component::ContainsWord,
+                  columns(PlaylistItem::ArtistColumn, PlaylistItem::AlbumColumn)),
+             SearchIndex::ItemSet());
+
+    // A word that isn't anywhere still lets the index answer.
+
+    bool found = false;
+
+    QCOMPARE(find("yesterday", Component::ContainsWord, all, &found), SearchIndex::ItemSet());
+    QVERIFY(found);
+
+    // Queries without any words can't be looked up.
+
+    find("  - ", Component::ContainsWord, all, &found);
+    QVERIFY(!found);
+}
+
+void SearchIndexTest::testTrigrams()
+{
+    const ColumnList all = columns(PlaylistItem::TrackColumn, PlaylistItem::ArtistColumn);
+
+    QCOMPARE(find("beat", Component::Contains, all), itemSet(0, 3));
+    QCOMPARE(find("the b", Component::Contains, all), itemSet(0, 3));
+    QCOMPARE(find("ing", Component::Contains, all), itemSet(1, 2));
+    QCOMPARE(find("oad", Component::Contains, all), itemSet(2, 3));
+    QCOMPARE(find("zzz", Component::Contains, all), SearchIndex::ItemSet());
+
+    // The trigrams have to be found in the same column, although they may
+    // come up in a different order than in the query, so the candidates can
+    // still be more than what matches.
+
+    QCOMPARE(find("ether", Component::Contains, all), itemSet(0));
+    QCOMPARE(find("roadtrip", Component::Contains, all), SearchIndex::ItemSet());
+
+    // Too short to be worth looking up.
+
+    bool found = true;
+
+    find("be", Component::Contains, all, &found);
+    QVERIFY(!found);
+}
+
+void SearchIndexTest::testColumns()
+{
+    QCOMPARE(find("road", Component::ContainsWord, columns(PlaylistItem::AlbumColumn)),
+             itemSet(0));
+    QCOMPARE(find("road", Component::ContainsWord, columns(PlaylistItem::TrackColumn)),
+             itemSet(2, 3));
+    QCOMPARE(find("road", Component::ContainsWord, columns(PlaylistItem::ArtistColumn)),
+             SearchIndex::ItemSet());
+    QCOMPARE(find("the", Component::ContainsWord, columns(PlaylistItem::ArtistColumn)),
+             itemSet(0, 1, 3));
+    QCOMPARE(find("the", Component::ContainsWord,
+                  columns(PlaylistItem::AlbumColumn, PlaylistItem::GenreColumn)),
+             SearchIndex::ItemSet());
+}
+
+void SearchIndexTest::testNotIndexed()
+{
+    m_index.insert(fakeItem(4), keys("comment", QString(), QString(), "road"));
+
+    bool found = true;
+
+    // Comments aren't indexed, so a search including them can't use the index.
+
+    find("road", Component::ContainsWord,
+         columns(PlaylistItem::TrackColumn, PlaylistItem::CommentColumn), &found);
+    QVERIFY(!found);
+
+    find("road", Component::ContainsWord, columns(PlaylistItem::FileNameColumn), &found);
+    QVERIFY(!found);
+
+    find("road", Component::ContainsWord, ColumnList(), &found);
+    QVERIFY(!found);
+
+    find(QString(), Component::ContainsWord, columns(PlaylistItem::TrackColumn), &found);
+    QVERIFY(!found);
+
+    find("1 - 2", Component::InRange, columns(PlaylistItem::TrackColumn), &found);
+    QVERIFY(!found);
+
+    // The comment isn't found in the other columns either.
+
+    QCOMPARE(find("road", Component::ContainsWord, columns(PlaylistItem::TrackColumn)),
+             itemSet(2, 3));
+}
+
+void SearchIndexTest::testInsertAgain()
+{
+    m_index.insert(fakeItem(0), keys("something", "the beatles", "let it be"));
+
+    const ColumnList all = columns(PlaylistItem::TrackColumn, PlaylistItem::AlbumColumn);
+
+    QCOMPARE(find("road", Component::ContainsWord, all), itemSet(2, 3));
+    QCOMPARE(find("let", Component::ContainsWord, all), itemSet(0, 1));
+    QCOMPARE(find("beatles", Component::ContainsWord, columns(PlaylistItem::ArtistColumn)),
+             itemSet(0, 3));
+
+    m_index.remove(fakeItem(3));
+    m_index.remove(fakeItem(100));
+
+    QCOMPARE(find("beatles", Component::ContainsWord, columns(PlaylistItem::ArtistColumn)),
+             itemSet(0));
+    QCOMPARE(find("road", Component::ContainsWord, all), itemSet(2));
+}
+
+void SearchIndexTest::testCompaction()
+{
+    const int count = 3000;
+    const ColumnList all = columns(PlaylistItem::TrackColumn, PlaylistItem::ArtistColumn);
+
+    m_index.clear();
+
+    for(int i = 0; i < count; ++i)
+        m_index.insert(fakeItem(i), keys(QString("song%1").arg(i), "everyone"));
+
+    // Refreshing items removes and adds them again, which leaves enough stale
+    // postings behind for the index to be compacted several times over.
+
+    for(int round = 0; round < 4; ++round) {
+        for(int i = 0; i < count; ++i) {
+            if(i % 3 != 0)
+                m_index.remove(fakeItem(i));
+        }
+
+        SearchIndex::ItemSet expected;
+
+        for(int i = 0; i < count; i += 3)
+            expected.insert(fakeItem(i));
+
+        QCOMPARE(find("everyone", Component::ContainsWord, all), expected);
+
+        for(int i = 0; i < count; ++i) {
+            if(i % 3 != 0) {
+                m_index.insert(fakeItem(i), keys(QString("song%1").arg(i), "everyone",
+                                                 QString("round%1").arg(round)));
+            }
+        }
+
+        QCOMPARE(find("everyone", Component::ContainsWord, all).count(), count);
+        QCOMPARE(find(QString("round%1").arg(round), Component::ContainsWord,
+                      columns(PlaylistItem::AlbumColumn)).count(),
+                 count - expected.count());
+
+        for(int i = 0; i < count; i += 301) {
+            QCOMPARE(find(QString("song%1").arg(i), Component::ContainsWord, all),
+                     itemSet(i));
+            QCOMPARE(find(QString("song%1 everyone").arg(i), Component::ContainsWord, all),
+                     SearchIndex::ItemSet());
+        }
+    }
+
+    // Only the last round's album is left.
+
+    QCOMPARE(find("round0", Component::ContainsWord, columns(PlaylistItem::AlbumColumn)),
+             SearchIndex::ItemSet());
+}
+
+SearchIndex::ItemSet SearchIndexTest::find(const QString &query, Component::MatchMode mode,
+                                           const ColumnList &columns, bool *found) const
+{
+    SearchIndex::ItemSet items;
+    const bool result = m_index.findCandidates(query, mode, columns, &items);
+
+    if(found)
+        *found = result;
+
+    return items;
+}
+
+QTEST_KDEMAIN_CORE(SearchIndexTest)
+
+// vim: set et sw=4 tw=0 sta:
+
+#include "searchindextest.moc"
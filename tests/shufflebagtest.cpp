@@ -0,0 +1,166 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "shufflebag.h"
+#include "fakepointer.h"
+#include <qtest_kde.h>
+#include <QSet>
+
+static PlaylistItem *fakeItem(int i)
+{
+    return fakePointer<PlaylistItem>(i);
+}
+
+static PlaylistItemList fakeItems(int count)
+{
+    PlaylistItemList items;
+
+    for(int i = 0; i < count; ++i)
+        items.append(fakeItem(i));
+
+    return items;
+}
+
+static PlaylistItemList drawAll(ShuffleBag &bag)
+{
+    PlaylistItemList drawn;
+
+    while(!bag.isEmpty())
+        drawn.append(bag.draw());
+
+    return drawn;
+}
+
+class ShuffleBagTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testSameSeed();
+    void testDifferentSeed();
+    void testFill();
+    void testRemove();
+};
+
+void ShuffleBagTest::testSameSeed()
+{
+    ShuffleBag first;
+    first.setSeed(1234);
+    first.fill(fakeItems(50));
+
+    ShuffleBag second;
+    second.setSeed(1234);
+    second.fill(fakeItems(50));
+
+    const PlaylistItemList order = drawAll(first);
+
+    QCOMPARE(order.count(), 50);
+    QCOMPARE(drawAll(second), order);
+
+    // Every item comes out exactly once.
+
+    QCOMPARE(order.toSet().count(), 50);
+
+    // A zero seed must not leave the generator stuck.
+
+    ShuffleBag zero;
+    zero.setSeed(0);
+    zero.fill(fakeItems(50));
+
+    QCOMPARE(drawAll(zero).toSet().count(), 50);
+}
+
+void ShuffleBagTest::testDifferentSeed()
+{
+    ShuffleBag first;
+    first.setSeed(1);
+    first.fill(fakeItems(50));
+
+    ShuffleBag second;
+    second.setSeed(2);
+    second.fill(fakeItems(50));
+
+    QVERIFY(drawAll(first) != drawAll(second));
+}
+
+void ShuffleBagTest::testFill()
+{
+    PlaylistItemList items = fakeItems(10);
+    items.append(fakeItem(3));
+
+    ShuffleBag bag;
+    bag.fill(items);
+
+    QCOMPARE(bag.count(), 10);
+    QVERIFY(bag.contains(fakeItem(3)));
+    QVERIFY(!bag.contains(fakeItem(10)));
+
+    bag.fill(fakeItems(2));
+
+    QCOMPARE(bag.count(), 2);
+    QVERIFY(!bag.contains(fakeItem(3)));
+
+    bag.clear();
+
+    QVERIFY(bag.isEmpty());
+}
+
+void ShuffleBagTest::testRemove()
+{
+    ShuffleBag bag;
+    bag.setSeed(42);
+    bag.fill(fakeItems(20));
+
+    // Take out the first, a middle and the last item, and one that isn't in
+    // the bag at all.
+
+    bag.remove(fakeItem(0));
+    bag.remove(fakeItem(10));
+    bag.remove(fakeItem(19));
+    bag.remove(fakeItem(100));
+
+    QCOMPARE(bag.count(), 17);
+    QVERIFY(!bag.contains(fakeItem(0)));
+    QVERIFY(!bag.contains(fakeItem(10)));
+    QVERIFY(!bag.contains(fakeItem(19)));
+
+    // Removing what pick() returned has to leave every other item reachable,
+    // which only works if the positions were kept up to date.
+
+    PlaylistItem *picked = bag.pick();
+    QVERIFY(bag.contains(picked));
+    bag.remove(picked);
+    QVERIFY(!bag.contains(picked));
+
+    QSet<PlaylistItem *> left;
+
+    for(int i = 0; i < 20; ++i) {
+        if(bag.contains(fakeItem(i)))
+            left.insert(fakeItem(i));
+    }
+
+    QCOMPARE(left.count(), 16);
+
+    const PlaylistItemList drawn = drawAll(bag);
+
+    QCOMPARE(drawn.count(), 16);
+    QCOMPARE(drawn.toSet(), left);
+    QCOMPARE(bag.count(), 0);
+}
+
+QTEST_KDEMAIN_CORE(ShuffleBagTest)
+
+// vim: set et sw=4 tw=0 sta:
+
+#include "shufflebagtest.moc"
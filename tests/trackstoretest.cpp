@@ -0,0 +1,186 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trackstore.h"
+#include <qtest_kde.h>
+
+class TrackStoreTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testFields();
+    void testInterning();
+    void testCopy();
+    void testRelease();
+    void testKeys();
+};
+
+void TrackStoreTest::testFields()
+{
+    TrackStore *store = TrackStore::instance();
+    const int row = store->createRow();
+
+    QCOMPARE(store->text(row, TrackStore::Title), QString());
+    QCOMPARE(store->track(row), 0);
+    QVERIFY(!store->isValid(row));
+
+    store->setFileName(row, "/music/a.mp3");
+    store->setText(row, TrackStore::Title, "Title");
+    store->setText(row, TrackStore::Comment, "Comment");
+    store->setTrack(row, 3);
+    store->setYear(row, 1999);
+    store->setSeconds(row, 245);
+    store->setBitrate(row, 192);
+    store->setValid(row, true);
+
+    QCOMPARE(store->fileName(row), QString("/music/a.mp3"));
+    QCOMPARE(store->text(row, TrackStore::Title), QString("Title"));
+    QCOMPARE(store->text(row, TrackStore::Artist), QString());
+    QCOMPARE(store->text(row, TrackStore::Comment), QString("Comment"));
+    QCOMPARE(store->track(row), 3);
+    QCOMPARE(store->year(row), 1999);
+    QCOMPARE(store->seconds(row), 245);
+    QCOMPARE(store->bitrate(row), 192);
+    QVERIFY(store->isValid(row));
+
+    // The packed numbers don't wrap around.
+
+    store->setTrack(row, -1);
+    QCOMPARE(store->track(row), 0);
+
+    store->setYear(row, 100000);
+    QCOMPARE(store->year(row), 0xffff);
+
+    store->releaseRow(row);
+}
+
+void TrackStoreTest::testInterning()
+{
+    TrackStore *store = TrackStore::instance();
+    const int first = store->createRow();
+    const int second = store->createRow();
+
+    store->setText(first, TrackStore::Artist, "Artist");
+    store->setText(second, TrackStore::Artist, QString("Art") + "ist");
+    store->setText(second, TrackStore::Album, "Artist");
+
+    const TrackStore::StringId id = store->textId(first, TrackStore::Artist);
+
+    QVERIFY(id != 0);
+    QCOMPARE(store->textId(second, TrackStore::Artist), id);
+    QCOMPARE(store->textId(second, TrackStore::Album), id);
+    QCOMPARE(store->string(id), QString("Artist"));
+
+    // Empty strings are all the same id.
+
+    store->setText(first, TrackStore::Genre, "");
+    QCOMPARE(store->textId(first, TrackStore::Genre), store->textId(first, TrackStore::Comment));
+
+    store->releaseRow(first);
+    store->releaseRow(second);
+}
+
+void TrackStoreTest::testCopy()
+{
+    TrackStore *store = TrackStore::instance();
+    const int row = store->createRow();
+
+    store->setText(row, TrackStore::Title, "Copied");
+    store->setYear(row, 2001);
+
+    const int copy = store->copyRow(row);
+    QVERIFY(copy != row);
+
+    const TrackStore::StringId id = store->textId(row, TrackStore::Title);
+
+    // Changing or releasing the original doesn't touch the copy.
+
+    store->setText(row, TrackStore::Title, "Changed");
+    store->setYear(row, 2002);
+    store->releaseRow(row);
+
+    QCOMPARE(store->textId(copy, TrackStore::Title), id);
+    QCOMPARE(store->text(copy, TrackStore::Title), QString("Copied"));
+    QCOMPARE(store->year(copy), 2001);
+
+    store->releaseRow(copy);
+}
+
+void TrackStoreTest::testRelease()
+{
+    TrackStore *store = TrackStore::instance();
+    const int row = store->createRow();
+
+    store->setText(row, TrackStore::Title, "Released");
+    const TrackStore::StringId id = store->textId(row, TrackStore::Title);
+
+    store->setText(row, TrackStore::Title, "Other");
+
+    // The string isn't used anymore, so its id gets reused.
+
+    QCOMPARE(store->string(id), QString());
+
+    store->setText(row, TrackStore::Album, "Reused");
+    QCOMPARE(store->textId(row, TrackStore::Album), id);
+
+    store->releaseRow(row);
+
+    // So does the row.
+
+    const int newRow = store->createRow();
+    QCOMPARE(newRow, row);
+    QCOMPARE(store->text(newRow, TrackStore::Album), QString());
+
+    store->releaseRow(newRow);
+}
+
+void TrackStoreTest::testKeys()
+{
+    TrackStore *store = TrackStore::instance();
+    const int row = store->createRow();
+
+    store->setText(row, TrackStore::Title, "Keyed");
+    const TrackStore::StringId id = store->textId(row, TrackStore::Title);
+
+    QVERIFY(!store->keys(id));
+
+    TrackStore::StringKeys *keys = new TrackStore::StringKeys;
+    keys->searchKey = "keyed";
+    QCOMPARE(store->setKeys(id, keys), keys);
+    QCOMPARE(store->keys(id), keys);
+
+    // Whoever sets the keys first wins.
+
+    TrackStore::StringKeys *otherKeys = new TrackStore::StringKeys;
+    otherKeys->searchKey = "other";
+    QCOMPARE(store->setKeys(id, otherKeys), keys);
+
+    // The keys go with the string.
+
+    store->releaseRow(row);
+
+    const int newRow = store->createRow();
+    store->setText(newRow, TrackStore::Title, "New");
+    QCOMPARE(store->textId(newRow, TrackStore::Title), id);
+    QVERIFY(!store->keys(id));
+
+    store->releaseRow(newRow);
+}
+
+QTEST_KDEMAIN_CORE(TrackStoreTest)
+
+// vim: set et sw=4 tw=0 sta:
+
+#include "trackstoretest.moc"
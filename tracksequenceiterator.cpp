@@ -23,6 +23,7 @@
 #include <ktoggleaction.h>
 
 #include "playlist.h"
+#include "collectionlist.h"
 #include "actioncollection.h"
 #include "tag.h"
 #include "filehandle.h"
@@ -57,12 +58,14 @@ void TrackSequenceIterator::itemAboutToDie(const PlaylistItem *)
 }
 
 DefaultSequenceIterator::DefaultSequenceIterator() :
-    TrackSequenceIterator()
+    TrackSequenceIterator(),
+    m_randomItemsStale(false)
 {
 }
 
 DefaultSequenceIterator::DefaultSequenceIterator(const DefaultSequenceIterator &other)
-    : TrackSequenceIterator(other)
+    : TrackSequenceIterator(other),
+      m_randomItemsStale(false)
 {
 }
 
@@ -80,6 +83,9 @@ void DefaultSequenceIterator::advance()
     bool albumRandom = action("albumRandomPlay") && action<KToggleAction>("albumRandomPlay")->isChecked();
 
     if(isRandom || albumRandom) {
+        if(m_randomItemsStale)
+            refillRandomList();
+
         if(m_randomItems.isEmpty() && loop) {
 
             // Since refillRandomList will remove the currently playing item,
@@ -100,46 +106,25 @@ void DefaultSequenceIterator::advance()
         PlaylistItem *item;
 
         if(albumRandom) {
-            if(m_albumSearch.isNull() || m_albumSearch.matchedItems().isEmpty()) {
-                item = m_randomItems[KRandom::random() % m_randomItems.count()];
-                initAlbumSearch(item);
+            if(m_albumItems.isEmpty()) {
+                item = m_randomItems.pick();
+                initAlbumItems(item);
             }
 
-            // This can be null if initAlbumSearch() left the m_albumSearch
-            // empty because the album text was empty.  Since we initAlbumSearch()
-            // with an item, the matchedItems() should never be empty.
-
-            if(!m_albumSearch.isNull()) {
-                PlaylistItemList albumMatches = m_albumSearch.matchedItems();
-                if(albumMatches.isEmpty()) {
-                    kError() << "Unable to initialize album random play.\n";
-                    kError() << "List of potential results is empty.\n";
-
-                    return; // item is still set to random song from a few lines earlier.
-                }
-
-                item = albumMatches[0];
-
-                // Pick first song remaining in list.
-
-                for(int i = 0; i < albumMatches.count(); ++i)
-                    if(albumMatches[i]->file().tag()->track() < item->file().tag()->track())
-                        item = albumMatches[i];
-                m_albumSearch.clearItem(item);
+            // The album's tracks can only be missing if the album text was
+            // empty, in which case the random track is played on its own.
 
-                if(m_albumSearch.matchedItems().isEmpty()) {
-                    m_albumSearch.clearComponents();
-                    m_albumSearch.search();
-                }
-            }
+            if(!m_albumItems.isEmpty())
+                item = m_albumItems.takeFirst();
             else
-                kError() << "Unable to perform album random play on " << *item << endl;
+                kError() << "Unable to perform album random play on " << *item;
         }
         else
-            item = m_randomItems[KRandom::random() % m_randomItems.count()];
+            item = m_randomItems.draw();
+
+        // setCurrent() takes the item out of the bag if it was only picked.
 
         setCurrent(item);
-        m_randomItems.removeAll(item);
     }
     else {
         PlaylistItem *next = current()->itemBelow();
@@ -194,20 +179,24 @@ void DefaultSequenceIterator::prepareToPlay(Playlist *playlist)
 void DefaultSequenceIterator::reset()
 {
     m_randomItems.clear();
-    m_albumSearch.clearComponents();
-    m_albumSearch.search();
+    m_randomItemsStale = false;
+    m_albumItems.clear();
     setCurrent(0);
 }
 
 void DefaultSequenceIterator::playlistChanged()
 {
-    refillRandomList();
+    // Searches can change the visible items on every keystroke, so the random
+    // list is only rebuilt once it's needed again.
+
+    m_randomItemsStale = true;
+    m_albumItems.clear();
 }
 
 void DefaultSequenceIterator::itemAboutToDie(const PlaylistItem *item)
 {
-    PlaylistItem *stfu_gcc = const_cast<PlaylistItem *>(item);
-    m_randomItems.removeAll(stfu_gcc);
+    m_randomItems.remove(item);
+    m_albumItems.removeAll(const_cast<PlaylistItem *>(item));
 }
 
 void DefaultSequenceIterator::setCurrent(PlaylistItem *current)
@@ -219,7 +208,9 @@ void DefaultSequenceIterator::setCurrent(PlaylistItem *current)
     bool random = action("randomPlay") && action<KToggleAction>("randomPlay")->isChecked();
     bool albumRandom = action("albumRandomPlay") && action<KToggleAction>("albumRandomPlay")->isChecked();
 
-    if((albumRandom || random) && current && m_randomItems.isEmpty()) {
+    if((albumRandom || random) && current &&
+       (m_randomItems.isEmpty() || m_randomItemsStale))
+    {
 
         // We're setting a current item, refill the random list now, and remove
         // the current item.
@@ -227,14 +218,14 @@ void DefaultSequenceIterator::setCurrent(PlaylistItem *current)
         refillRandomList();
     }
 
-    m_randomItems.removeAll(current);
+    m_randomItems.remove(current);
 
     if(albumRandom && current && !oldCurrent) {
 
         // Same idea as above
 
-        initAlbumSearch(current);
-        m_albumSearch.clearItem(current);
+        initAlbumItems(current);
+        m_albumItems.removeAll(current);
     }
 }
 
@@ -257,57 +248,41 @@ void DefaultSequenceIterator::refillRandomList(Playlist *p)
         }
     }
 
-    m_randomItems = p->visibleItems();
-    m_randomItems.removeAll(current());
-    m_albumSearch.clearComponents();
-    m_albumSearch.search();
+    m_randomItems.fill(p->visibleItems());
+    m_randomItems.remove(current());
+    m_randomItemsStale = false;
+    m_albumItems.clear();
 }
 
-void DefaultSequenceIterator::initAlbumSearch(PlaylistItem *searchItem)
+void DefaultSequenceIterator::initAlbumItems(PlaylistItem *searchItem)
 {
+    m_albumItems.clear();
+
     if(!searchItem)
         return;
 
-    m_albumSearch.clearPlaylists();
-    m_albumSearch.addPlaylist(searchItem->playlist());
+    Playlist *playlist = searchItem->playlist();
+    const AlbumIndex &index = CollectionList::instance()->albumIndex();
+    const QString artist = searchItem->file().tag()->artist();
+    const QString album = searchItem->file().tag()->album();
 
-    ColumnList columns;
+    // Unlike the index, album random play matches the names case sensitively,
+    // and only looks at the album if the track has no artist, so that e.g. a
+    // compilation without artist tags is still played as a whole.
 
-    m_albumSearch.setSearchMode(PlaylistSearch::MatchAll);
-    m_albumSearch.clearComponents();
+    const AlbumIndex::ItemList tracks =
+        artist.isEmpty() ? index.tracks(album) : index.tracks(artist, album);
 
-    // If the album name is empty, it will mess up the search,
-    // so ignore empty album names.
+    foreach(CollectionListItem *track, tracks) {
+        const Tag *tag = track->file().tag();
 
-    if(searchItem->file().tag()->album().isEmpty())
-        return;
+        if(tag->album() != album || (!artist.isEmpty() && tag->artist() != artist))
+            continue;
 
-    columns.append(PlaylistItem::AlbumColumn);
-
-    m_albumSearch.addComponent(PlaylistSearch::Component(
-        searchItem->file().tag()->album(),
-        true,
-        columns,
-        PlaylistSearch::Component::Exact)
-    );
-
-    // If there is an Artist tag with the track, match against it as well
-    // to avoid things like multiple "Greatest Hits" albums matching the
-    // search.
-
-    if(!searchItem->file().tag()->artist().isEmpty()) {
-        kDebug() << "Searching both artist and album.";
-        columns[0] = PlaylistItem::ArtistColumn;
-
-        m_albumSearch.addComponent(PlaylistSearch::Component(
-            searchItem->file().tag()->artist(),
-            true,
-            columns,
-            PlaylistSearch::Component::Exact)
-        );
+        PlaylistItem *item = track->itemForPlaylist(playlist);
+        if(item)
+            m_albumItems.append(item);
     }
-
-    m_albumSearch.search();
 }
 
 // vim: set et sw=4 tw=0 sta:
@@ -18,7 +18,7 @@
 #define TRACKSEQUENCEITERATOR_H
 
 #include "playlistitem.h"
-#include "playlistsearch.h"
+#include "shufflebag.h"
 
 class Playlist;
 
@@ -183,8 +183,9 @@ public:
     virtual void reset();
 
     /**
-     * This function recalculates the random lists, and is should be called
-     * whenever its current playlist changes (at least for searches).
+     * This function marks the random lists as out of date, and should be
+     * called whenever its current playlist changes (at least for searches).
+     * They are recalculated the next time they're needed.
      */
     virtual void playlistChanged();
 
@@ -221,11 +222,17 @@ private:
      *        the currently playing item is used instead.
      */
     void refillRandomList(Playlist *p = 0);
-    void initAlbumSearch(PlaylistItem *searchItem);
+
+    /**
+     * Sets the album tracks left to play to those in the playlist of
+     * \p searchItem which are on the same album, in track order.
+     */
+    void initAlbumItems(PlaylistItem *searchItem);
 
 private:
-    PlaylistItemList m_randomItems;
-    PlaylistSearch m_albumSearch;
+    ShuffleBag m_randomItems;
+    bool m_randomItemsStale;
+    PlaylistItemList m_albumItems;
 };
 
 #endif /* TRACKSEQUENCEITERATOR_H */
@@ -0,0 +1,355 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "trackstore.h"
+
+#include <kdebug.h>
+
+#include <QtCore/QAtomicPointer>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QMutexLocker>
+#include <QtCore/QVector>
+
+#include <string.h>
+
+static const int chunkSize = 1024;
+
+// Enough for sixteen million rows and as many distinct strings.  The chunk
+// tables are allocated up front so that readers never see them move.
+
+static const int maxChunks = 16384;
+
+static const int maxNumber = 0xffff;
+
+namespace {
+
+struct RowChunk
+{
+    QString fileName[chunkSize];
+    TrackStore::StringId text[TrackStore::TextFieldCount][chunkSize];
+    qint32 seconds[chunkSize];
+    quint16 track[chunkSize];
+    quint16 year[chunkSize];
+    quint16 bitrate[chunkSize];
+    bool valid[chunkSize];
+};
+
+struct StringChunk
+{
+    QString string[chunkSize];
+    int refs[chunkSize];
+    QAtomicPointer<TrackStore::StringKeys> keys[chunkSize];
+};
+
+} // namespace
+
+class TrackStore::Private
+{
+public:
+    Private();
+
+    int allocateRow();
+    StringId intern(const QString &text);
+    void retain(StringId id);
+    void release(StringId id);
+
+    RowChunk *rows[maxChunks];
+    StringChunk *strings[maxChunks];
+
+    // Everything below is only used with the mutex held.
+
+    QMutex mutex;
+    int rowCount;
+    QVector<int> freeRows;
+    StringId stringCount;
+    QVector<StringId> freeStrings;
+    QHash<QString, StringId> stringIds;
+};
+
+////////////////////////////////////////////////////////////////////////////////
+// TrackStore::Private
+////////////////////////////////////////////////////////////////////////////////
+
+TrackStore::Private::Private() :
+    rowCount(0),
+    stringCount(1)
+{
+    memset(rows, 0, sizeof(rows));
+    memset(strings, 0, sizeof(strings));
+
+    // The id 0 is the empty string, which isn't reference counted.
+
+    strings[0] = new StringChunk;
+    strings[0]->refs[0] = 0;
+}
+
+int TrackStore::Private::allocateRow()
+{
+    if(!freeRows.isEmpty()) {
+        const int row = freeRows.last();
+        freeRows.removeLast();
+        return row;
+    }
+
+    const int row = rowCount++;
+
+    if(row % chunkSize == 0) {
+        if(row / chunkSize >= maxChunks)
+            kFatal() << "Too many tracks for the track store";
+
+        rows[row / chunkSize] = new RowChunk;
+    }
+
+    return row;
+}
+
+TrackStore::StringId TrackStore::Private::intern(const QString &text)
+{
+    if(text.isEmpty())
+        return 0;
+
+    QHash<QString, StringId>::ConstIterator it = stringIds.constFind(text);
+    if(it != stringIds.constEnd()) {
+        retain(it.value());
+        return it.value();
+    }
+
+    StringId id;
+
+    if(!freeStrings.isEmpty()) {
+        id = freeStrings.last();
+        freeStrings.removeLast();
+    }
+    else {
+        id = stringCount++;
+
+        if(id % chunkSize == 0) {
+            if(id / chunkSize >= StringId(maxChunks))
+                kFatal() << "Too many strings for the track store";
+
+            strings[id / chunkSize] = new StringChunk;
+        }
+    }
+
+    StringChunk *chunk = strings[id / chunkSize];
+
+    chunk->string[id % chunkSize] = text;
+    chunk->refs[id % chunkSize] = 1;
+    stringIds.insert(text, id);
+
+    return id;
+}
+
+void TrackStore::Private::retain(StringId id)
+{
+    if(id != 0)
+        ++strings[id / chunkSize]->refs[id % chunkSize];
+}
+
+void TrackStore::Private::release(StringId id)
+{
+    if(id == 0)
+        return;
+
+    StringChunk *chunk = strings[id / chunkSize];
+    const int i = id % chunkSize;
+
+    if(--chunk->refs[i] > 0)
+        return;
+
+    stringIds.remove(chunk->string[i]);
+    chunk->string[i] = QString();
+    delete chunk->keys[i].fetchAndStoreOrdered(0);
+
+    freeStrings.append(id);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// public members
+////////////////////////////////////////////////////////////////////////////////
+
+TrackStore *TrackStore::instance() // static
+{
+    // Initialized on first use, which may be from the cache loading thread.
+    static TrackStore *const store = new TrackStore;
+    return store;
+}
+
+int TrackStore::createRow()
+{
+    QMutexLocker locker(&d->mutex);
+
+    const int row = d->allocateRow();
+    RowChunk *chunk = d->rows[row / chunkSize];
+    const int i = row % chunkSize;
+
+    chunk->fileName[i] = QString();
+    for(int field = 0; field < TextFieldCount; ++field)
+        chunk->text[field][i] = 0;
+    chunk->seconds[i] = 0;
+    chunk->track[i] = 0;
+    chunk->year[i] = 0;
+    chunk->bitrate[i] = 0;
+    chunk->valid[i] = false;
+
+    return row;
+}
+
+int TrackStore::copyRow(int row)
+{
+    QMutexLocker locker(&d->mutex);
+
+    const int copy = d->allocateRow();
+    const RowChunk *from = d->rows[row / chunkSize];
+    RowChunk *to = d->rows[copy / chunkSize];
+    const int i = row % chunkSize;
+    const int j = copy % chunkSize;
+
+    to->fileName[j] = from->fileName[i];
+    for(int field = 0; field < TextFieldCount; ++field) {
+        to->text[field][j] = from->text[field][i];
+        d->retain(from->text[field][i]);
+    }
+    to->seconds[j] = from->seconds[i];
+    to->track[j] = from->track[i];
+    to->year[j] = from->year[i];
+    to->bitrate[j] = from->bitrate[i];
+    to->valid[j] = from->valid[i];
+
+    return copy;
+}
+
+void TrackStore::releaseRow(int row)
+{
+    QMutexLocker locker(&d->mutex);
+
+    RowChunk *chunk = d->rows[row / chunkSize];
+    const int i = row % chunkSize;
+
+    for(int field = 0; field < TextFieldCount; ++field)
+        d->release(chunk->text[field][i]);
+
+    chunk->fileName[i] = QString();
+    d->freeRows.append(row);
+}
+
+QString TrackStore::fileName(int row) const
+{
+    return d->rows[row / chunkSize]->fileName[row % chunkSize];
+}
+
+void TrackStore::setFileName(int row, const QString &fileName)
+{
+    d->rows[row / chunkSize]->fileName[row % chunkSize] = fileName;
+}
+
+TrackStore::StringId TrackStore::textId(int row, TextField field) const
+{
+    return d->rows[row / chunkSize]->text[field][row % chunkSize];
+}
+
+void TrackStore::setText(int row, TextField field, const QString &text)
+{
+    QMutexLocker locker(&d->mutex);
+
+    StringId &id = d->rows[row / chunkSize]->text[field][row % chunkSize];
+    const StringId oldId = id;
+
+    id = d->intern(text);
+    d->release(oldId);
+}
+
+int TrackStore::track(int row) const
+{
+    return d->rows[row / chunkSize]->track[row % chunkSize];
+}
+
+void TrackStore::setTrack(int row, int track)
+{
+    d->rows[row / chunkSize]->track[row % chunkSize] = qBound(0, track, maxNumber);
+}
+
+int TrackStore::year(int row) const
+{
+    return d->rows[row / chunkSize]->year[row % chunkSize];
+}
+
+void TrackStore::setYear(int row, int year)
+{
+    d->rows[row / chunkSize]->year[row % chunkSize] = qBound(0, year, maxNumber);
+}
+
+int TrackStore::seconds(int row) const
+{
+    return d->rows[row / chunkSize]->seconds[row % chunkSize];
+}
+
+void TrackStore::setSeconds(int row, int seconds)
+{
+    d->rows[row / chunkSize]->seconds[row % chunkSize] = seconds;
+}
+
+int TrackStore::bitrate(int row) const
+{
+    return d->rows[row / chunkSize]->bitrate[row % chunkSize];
+}
+
+void TrackStore::setBitrate(int row, int bitrate)
+{
+    d->rows[row / chunkSize]->bitrate[row % chunkSize] = qBound(0, bitrate, maxNumber);
+}
+
+bool TrackStore::isValid(int row) const
+{
+    return d->rows[row / chunkSize]->valid[row % chunkSize];
+}
+
+void TrackStore::setValid(int row, bool valid)
+{
+    d->rows[row / chunkSize]->valid[row % chunkSize] = valid;
+}
+
+QString TrackStore::string(StringId id) const
+{
+    return d->strings[id / chunkSize]->string[id % chunkSize];
+}
+
+const TrackStore::StringKeys *TrackStore::keys(StringId id) const
+{
+    return d->strings[id / chunkSize]->keys[id % chunkSize];
+}
+
+const TrackStore::StringKeys *TrackStore::setKeys(StringId id, StringKeys *keys)
+{
+    QAtomicPointer<StringKeys> &slot = d->strings[id / chunkSize]->keys[id % chunkSize];
+
+    if(slot.testAndSetOrdered(0, keys))
+        return keys;
+
+    delete keys;
+    return slot;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// private members
+////////////////////////////////////////////////////////////////////////////////
+
+TrackStore::TrackStore() :
+    d(new Private)
+{
+
+}
+
+// vim: set et sw=4 tw=0 sta:
@@ -0,0 +1,115 @@
+/**
+ * This program is free software; you can redistribute it and/or modify it under
+ * the terms of the GNU General Public License as published by the Free Software
+ * Foundation; either version 2 of the License, or (at your option) any later
+ * version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT ANY
+ * WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A
+ * PARTICULAR PURPOSE. See the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef JUK_TRACKSTORE_H
+#define JUK_TRACKSTORE_H
+
+#include <QtCore/QString>
+#include <QtCore/QByteArray>
+
+/**
+ * Holds the tags of every track a field at a time instead of as an object per
+ * track.  A Tag is only the number of its row in here.
+ *
+ * Rows are handed out from chunks which have an array for each field, so the
+ * numbers of neighbouring tracks are packed next to each other and no field
+ * needs an allocation of its own.  The text fields are stored as the ids of
+ * reference counted, interned strings, so each distinct artist, album and so
+ * on is only kept once, together with anything derived from it (see keys()).
+ *
+ * Tags are read on worker threads as well as on the GUI thread.  Chunks never
+ * move once they are allocated, so reading a row or a string doesn't lock;
+ * only creating and releasing them does.  A row is only used by the Tag that
+ * owns it, which is never used from two threads at once.
+ */
+
+class TrackStore
+{
+public:
+    typedef quint32 StringId;
+
+    enum TextField { Title, Artist, Album, Genre, Comment, TextFieldCount };
+
+    /**
+     * The forms of a string that sorting and searching compare, which are too
+     * expensive to recompute for every comparison.
+     */
+    struct StringKeys
+    {
+        QByteArray sortKey;
+        QString searchKey;
+        QString accentlessSearchKey;
+    };
+
+    static TrackStore *instance();
+
+    /**
+     * Returns a new row with every field empty.
+     */
+    int createRow();
+
+    /**
+     * Returns a new row with the same contents as \a row.
+     */
+    int copyRow(int row);
+
+    void releaseRow(int row);
+
+    QString fileName(int row) const;
+    void setFileName(int row, const QString &fileName);
+
+    StringId textId(int row, TextField field) const;
+    QString text(int row, TextField field) const { return string(textId(row, field)); }
+    void setText(int row, TextField field, const QString &text);
+
+    int track(int row) const;
+    void setTrack(int row, int track);
+
+    int year(int row) const;
+    void setYear(int row, int year);
+
+    int seconds(int row) const;
+    void setSeconds(int row, int seconds);
+
+    int bitrate(int row) const;
+    void setBitrate(int row, int bitrate);
+
+    bool isValid(int row) const;
+    void setValid(int row, bool valid);
+
+    QString string(StringId id) const;
+
+    /**
+     * Returns the keys set for the string \a id, or 0 if there are none yet.
+     */
+    const StringKeys *keys(StringId id) const;
+
+    /**
+     * Sets the keys of the string \a id, taking ownership of \a keys.  If
+     * another thread got there first its keys are kept and \a keys is deleted.
+     * Returns the keys that are kept.
+     */
+    const StringKeys *setKeys(StringId id, StringKeys *keys);
+
+private:
+    class Private;
+
+    TrackStore();
+
+    Private *d;
+};
+
+#endif
+
+// vim: set et sw=4 tw=0 sta:
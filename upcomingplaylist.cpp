@@ -26,6 +26,7 @@
 #include "tracksequencemanager.h"
 #include "collectionlist.h"
 #include "actioncollection.h"
+#include "mediafiles.h"
 
 using namespace ActionCollection;
 
@@ -119,10 +120,20 @@ void UpcomingPlaylist::addFiles(const QStringList &files, PlaylistItem *after)
 {
     CollectionList::instance()->addFiles(files, after);
 
+    // The collection list only creates its items once it has read the tags of
+    // the files in the background, so the ones queued here are created now.
+
+    CollectionList *collection = CollectionList::instance();
     PlaylistItemList l;
+
     foreach(const QString &file, files) {
+        if(MediaFiles::classify(file) != MediaFiles::MediaFile)
+            continue;
+
         FileHandle f(file);
-        PlaylistItem *i = CollectionList::instance()->lookup(f.absFilePath());
+        PlaylistItem *i = collection->lookup(f.absFilePath());
+        if(!i)
+            i = collection->createItem(f);
         if(i)
             l.append(i);
     }